@@ -55,6 +55,12 @@ let package = Package(
       cxxSettings: [.unsafeFlags(["-fmodules", "-fcxx-modules"], .none)],
       linkerSettings: [.linkedFramework("AVFoundation")]
     ),
+    .testTarget(
+      name: "KernelBenchmarks",
+      dependencies: ["Kernel", "KernelBridge", "Parameters", "ParameterAddress"],
+      exclude: ["Reference"],
+      linkerSettings: [.linkedFramework("AVFoundation")]
+    ),
     .testTarget(
       name: "ParameterAddressTests",
       dependencies: ["ParameterAddress"]
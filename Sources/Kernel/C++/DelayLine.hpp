@@ -0,0 +1,522 @@
+// Copyright © 2022 Brad Howes. All rights reserved.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+namespace Chorus {
+
+/**
+ The ways to calculate a sample that falls between two samples in a delay line. They are ordered from cheapest to
+ most expensive, except for `allpass` which is a bit cheaper than `cubic4thOrder` but keeps state between reads. The raw
+ values are those of the `quality` runtime parameter.
+ */
+enum class Interpolator {
+  /// Use the nearest sample
+  none = 0,
+  /// Linear interpolation between the two nearest samples
+  linear,
+  /// 4th-order cubic interpolation using the four nearest samples
+  cubic4thOrder,
+  /// First-order allpass interpolation using the two nearest samples. Flat magnitude response, but keeps state.
+  allpass
+};
+
+/**
+ Interpolation settings for a block of delay line reads. The integer offsets and the interpolation weights are
+ calculated once for up to `Lanes` frames and then shared by every channel that reads with the same delay values. All of
+ the loops below run over a fixed number of lanes so that the compiler can map them onto NEON / SSE registers.
+ */
+template <typename T, size_t Lanes>
+struct Taps {
+  static constexpr size_t lanes = Lanes;
+
+  /**
+   Calculate the tap offsets and interpolation weights for a block of frames.
+
+   @param delays the delay values (in samples) for each frame
+   @param count the number of frames to calculate. Must not be greater than `Lanes`.
+   @param maxDelay the largest delay (in samples) that can be read from the delay line
+   */
+  template <Interpolator I>
+  void compute(const T* delays, size_t count, T maxDelay) noexcept {
+    assert(count <= Lanes);
+    T fraction[Lanes];
+    for (size_t lane = 0; lane < Lanes; ++lane) {
+      // The cubic interpolation needs one sample newer than the tap, so the delay cannot be less than one sample.
+      auto delay = std::clamp<T>(lane < count ? delays[lane] : T(1), T(1), maxDelay);
+      if constexpr (I == Interpolator::none) delay += T(0.5);
+      auto whole = std::floor(delay);
+      offset[lane] = static_cast<size_t>(whole);
+      fraction[lane] = delay - whole;
+    }
+
+    if constexpr (I == Interpolator::linear) {
+      for (size_t lane = 0; lane < Lanes; ++lane) {
+        w1[lane] = T(1) - fraction[lane];
+        w2[lane] = fraction[lane];
+      }
+    } else if constexpr (I == Interpolator::cubic4thOrder) {
+      for (size_t lane = 0; lane < Lanes; ++lane) {
+        auto f1 = fraction[lane];
+        auto f2 = f1 * f1;
+        auto f3 = f2 * f1;
+        w0[lane] = -f3 + T(2) * f2 - f1;
+        w1[lane] = f3 - T(2) * f2 + T(1);
+        w2[lane] = -f3 + f2 + f1;
+        w3[lane] = f3 - f2;
+      }
+    } else if constexpr (I == Interpolator::allpass) {
+      // Keep the fraction in [0.5, 1.5) so that the allpass coefficient stays well away from -1.
+      for (size_t lane = 0; lane < Lanes; ++lane) {
+        auto shift = fraction[lane] < T(0.5) ? size_t(1) : size_t(0);
+        auto fraction1 = fraction[lane] + T(shift);
+        offset[lane] -= shift;
+        w1[lane] = (T(1) - fraction1) / (T(1) + fraction1);
+      }
+    }
+  }
+
+  size_t offset[Lanes];
+  T w0[Lanes];
+  T w1[Lanes];
+  T w2[Lanes];
+  T w3[Lanes];
+};
+
+/**
+ Conversion between the sample type used for processing and the type used to hold samples in a delay line. The default
+ keeps samples as they are.
+ */
+template <typename T, typename S>
+struct SampleCodec {
+  static S encode(T value, uint32_t&) noexcept { return S(value); }
+  static T decode(S value) noexcept { return T(value); }
+};
+
+/**
+ Samples held as 16-bit integers, with triangular dither added before rounding so that the quantization error is
+ noise and not distortion of quiet signals. Values outside of [-1, 1] are clipped.
+ */
+template <typename T>
+struct SampleCodec<T, int16_t> {
+  static constexpr T scale = T(32767);
+
+  static int16_t encode(T value, uint32_t& seed) noexcept {
+    auto dither = random(seed) - random(seed);
+    auto scaled = std::clamp<T>(value * scale + dither, -scale, scale);
+    return int16_t(std::lrint(scaled));
+  }
+
+  static T decode(int16_t value) noexcept { return T(value) * (T(1) / scale); }
+
+private:
+  /// @returns a value in [0, 1) from a linear congruential generator
+  static T random(uint32_t& seed) noexcept {
+    seed = seed * 1664525u + 1013904223u;
+    return T(seed >> 8) * T(1.0 / 16777216.0);
+  }
+};
+
+#if defined(__FLT16_MANT_DIG__)
+/// Half-precision floats are used for compact delay lines when the compiler supports them.
+using CompactSample = _Float16;
+#else
+/// Dithered 16-bit integers are used for compact delay lines when the compiler has no half-precision float type.
+using CompactSample = int16_t;
+#endif
+
+/**
+ A circular buffer of samples that can be read at fractional delays using one of the `Interpolator` methods. The
+ buffer size is always a power of 2 so that indices wrap with a bitmask.
+
+ A delay of `d` samples read after a `write` returns the sample written `d` calls to `write` ago, with fractional values
+ interpolated from the four nearest samples. The block API writes all of the samples for a block before reading, with
+ each frame's delay measured from the sample written for that frame, which yields the same results as interleaving
+ `write` and `read` calls.
+
+ A delay line does not own its samples -- it is a view into storage managed by a `DelayLinePool`. The samples may be
+ held in a smaller type `S`, such as `CompactSample`, in which case they are converted as they are written and read.
+ */
+template <typename T, typename S = T>
+class DelayLine {
+public:
+  using Codec = SampleCodec<T, S>;
+
+  /// The max number of taps that can be read by one `process` call.
+  static constexpr size_t maxTaps = 8;
+
+  /**
+   Make the delay line use the given storage. The samples are not changed.
+
+   @param buffer the start of the samples to use
+   @param size the number of samples available at `buffer`. Must be a power of 2.
+   */
+  void bind(S* buffer, size_t size) noexcept {
+    assert(size > 0 && (size & (size - 1)) == 0);
+    buffer_ = buffer;
+    capacity_ = size;
+    mask_ = size - 1;
+    writePos_ = 0;
+  }
+
+  /// @returns the number of samples held by the delay line
+  size_t size() const noexcept { return buffer_ == nullptr ? 0 : mask_ + 1; }
+
+  /// @returns the max number of samples that the delay line can hold with its storage
+  size_t capacity() const noexcept { return capacity_; }
+
+  /**
+   Change the number of samples held by the delay line without touching memory outside of its storage. The most recent
+   samples are kept where they can be read at the same delays as before: when growing, all of them, and when shrinking,
+   as many as the smaller size holds. The cost is at most one pass over the larger size.
+
+   @param size the new number of samples. Must be a power of 2 that is not greater than `capacity()`.
+   */
+  void resize(size_t size) noexcept {
+    assert(size > 0 && (size & (size - 1)) == 0 && size <= capacity_);
+    auto oldSize = this->size();
+    if (size == oldSize || oldSize == 0) return;
+    if (size > oldSize) {
+      // Samples at and after the write position are the oldest ones. Move them to the end of the larger ring so that
+      // they are the same distance behind the write position, and clear the gap that opens up.
+      std::copy_backward(buffer_ + writePos_, buffer_ + oldSize, buffer_ + size);
+      std::fill_n(buffer_ + writePos_, size - oldSize, S(0));
+    } else if (writePos_ >= size) {
+      // The newest samples are one contiguous run. Move it to the start and begin writing over the oldest of them.
+      std::copy(buffer_ + writePos_ - size, buffer_ + writePos_, buffer_);
+      writePos_ = 0;
+    } else {
+      // The newest samples wrap around the end of the ring. Those before the write position are already in place.
+      std::copy(buffer_ + oldSize - (size - writePos_), buffer_ + oldSize, buffer_ + writePos_);
+    }
+    mask_ = size - 1;
+  }
+
+  /**
+   Obtain the largest delay that can be read while writing blocks of samples.
+
+   @param blockSize the max number of samples written in one `process` call
+   @returns largest delay in samples
+   */
+  T maxDelay(size_t blockSize) const noexcept { return T(size() - blockSize - 3); }
+
+  /// Set all samples to zero.
+  void clear() noexcept {
+    std::fill_n(buffer_, size(), S(0));
+    allpassState_.fill(T(0));
+  }
+
+  /**
+   Set a tiny value to add to every sample written to the delay line. A bias well above the denormal range but far
+   below anything audible keeps decaying samples -- and the interpolation and mix calculations that use them -- out of
+   the denormal range on CPUs that do not flush them to zero. It is only useful when `S` is `T`: the 16-bit types of
+   compact storage cannot hold a value as small as the bias, so it rounds away, and the smallest value they can hold
+   decodes to a normal `T`, so compact delay lines never hold denormals to begin with.
+
+   @param bias the value to add, or 0 for none
+   */
+  void setBias(T bias) noexcept { bias_ = bias; }
+
+  /**
+   Add a sample to the delay line.
+
+   @param value the sample to add
+   */
+  void write(T value) noexcept {
+    buffer_[writePos_] = Codec::encode(value + bias_, ditherSeed_);
+    writePos_ = (writePos_ + 1) & mask_;
+  }
+
+  /**
+   Add a block of samples to the delay line.
+
+   @param input the samples to add
+   @param count the number of samples to add
+   */
+  void write(const T* input, size_t count) noexcept {
+    // Only the newest samples fit when the block is larger than the active part of the line.
+    if (count > size()) {
+      input += count - size();
+      count = size();
+    }
+
+    if constexpr (std::is_same_v<T, S>) {
+      if (bias_ == T(0)) {
+        auto first = std::min(count, size() - writePos_);
+        std::copy_n(input, first, buffer_ + writePos_);
+        std::copy_n(input + first, count - first, buffer_);
+        writePos_ = (writePos_ + count) & mask_;
+        return;
+      }
+    }
+
+    for (size_t index = 0; index < count; ++index) {
+      write(input[index]);
+    }
+  }
+
+  /**
+   Read a sample from the delay line using cubic interpolation.
+
+   @param delay how far back in samples to read, relative to the last sample that was written
+   @returns interpolated sample
+   */
+  T read(T delay) const noexcept {
+    Taps<T, 1> taps;
+    taps.template compute<Interpolator::cubic4thOrder>(&delay, 1, maxDelay(1));
+    return interpolate(taps, 0, (writePos_ - 1) & mask_);
+  }
+
+  /**
+   Add a block of samples to the delay line and then read one interpolated sample per frame.
+
+   @param input the samples to add
+   @param taps the interpolation settings to use for each frame. These must have been calculated for the same
+   `Interpolator` value.
+   @param count the number of frames to process. Must not be greater than the lane count of `taps`.
+   @param output the destination for the interpolated samples
+   */
+  template <Interpolator I, size_t Lanes>
+  void process(const T* input, const Taps<T, Lanes>& taps, size_t count, T* output) noexcept {
+    process<I>(input, &taps, 1, count, output);
+  }
+
+  /**
+   Add a block of samples to the delay line and then read several taps per frame, summing the interpolated samples.
+   The samples are written once no matter how many taps are read.
+
+   @param input the samples to add
+   @param taps the interpolation settings for each tap. These must have been calculated for the same `Interpolator`
+   value.
+   @param tapCount the number of entries in `taps`. Must be between 1 and `maxTaps`.
+   @param count the number of frames to process. Must not be greater than the lane count of `taps`.
+   @param output the destination for the sum of the interpolated samples
+   */
+  template <Interpolator I, size_t Lanes>
+  void process(const T* input, const Taps<T, Lanes>* taps, size_t tapCount, size_t count, T* output) noexcept {
+    assert(count <= Lanes);
+    assert(tapCount > 0 && tapCount <= maxTaps);
+    auto base = writePos_;
+    for (size_t frame = 0; frame < count; ++frame) {
+      write(input[frame]);
+    }
+
+    gatherTaps<I>(taps, tapCount, base, 0, count, output);
+  }
+
+  /**
+   Read several taps per frame, summing the interpolated samples, and add the samples that a feedback loop makes from
+   them. For each frame in turn, `loop.take(frame, delayed)` gets the sum read for the frame, and `loop.feed(frame)`
+   returns the sample to write for it. A frame is read before its sample is written, so the trip around the loop is
+   the tap delay and not the size of the block. When every tap of the block reaches back past the block, the whole
+   block is read at once. Otherwise the frames are read one at a time, and a frame whose taps need its own sample --
+   a delay of less than one sample, or two with cubic interpolation -- is written first, which makes its trip one
+   frame longer.
+
+   @param taps the interpolation settings for each tap. These must have been calculated for the same `Interpolator`
+   value.
+   @param tapCount the number of entries in `taps`. Must be between 1 and `maxTaps`.
+   @param count the number of frames to process. Must not be greater than the lane count of `taps`.
+   @param output the destination for the sum of the interpolated samples
+   @param loop the feedback loop that takes the samples read and makes the samples to write
+   */
+  template <Interpolator I, size_t Lanes, typename Loop>
+  void processFeedback(const Taps<T, Lanes>* taps, size_t tapCount, size_t count, T* output, Loop& loop) noexcept {
+    assert(count <= Lanes);
+    assert(tapCount > 0 && tapCount <= maxTaps);
+
+    // Cubic interpolation reads one sample newer than the tap offset.
+    constexpr size_t newest = I == Interpolator::cubic4thOrder ? 1 : 0;
+    bool beforeBlock = true;
+    for (size_t tap = 0; tap < tapCount; ++tap) {
+      for (size_t frame = 0; frame < count; ++frame) {
+        beforeBlock = beforeBlock && taps[tap].offset[frame] > frame + newest;
+      }
+    }
+
+    if (beforeBlock) {
+      gatherTaps<I>(taps, tapCount, writePos_, 0, count, output);
+      for (size_t frame = 0; frame < count; ++frame) {
+        loop.take(frame, output[frame]);
+        write(loop.feed(frame));
+      }
+      return;
+    }
+
+    for (size_t frame = 0; frame < count; ++frame) {
+      bool ahead = true;
+      for (size_t tap = 0; tap < tapCount; ++tap) ahead = ahead && taps[tap].offset[frame] > newest;
+      if (!ahead) write(loop.feed(frame));
+      gatherTaps<I>(taps, tapCount, ahead ? writePos_ : writePos_ - 1, frame, 1, output + frame);
+      loop.take(frame, output[frame]);
+      if (ahead) write(loop.feed(frame));
+    }
+  }
+
+private:
+
+  /**
+   Read the frames `first` to `first + count` of several taps and sum them.
+
+   @param taps the interpolation settings for each tap
+   @param tapCount the number of entries in `taps`
+   @param base the position in the buffer of the sample of frame `first`
+   @param first the first lane of the taps to read
+   @param count the number of frames to read
+   @param output the destination for the sums
+   */
+  template <Interpolator I, size_t Lanes>
+  void gatherTaps(const Taps<T, Lanes>* taps, size_t tapCount, size_t base, size_t first, size_t count,
+                  T* output) noexcept {
+    gather<I>(taps[0], base, first, count, output, allpassState_[0]);
+    for (size_t tap = 1; tap < tapCount; ++tap) {
+      T gathered[Lanes];
+      gather<I>(taps[tap], base, first, count, gathered, allpassState_[tap]);
+      for (size_t frame = 0; frame < count; ++frame) {
+        output[frame] += gathered[frame];
+      }
+    }
+  }
+
+  template <Interpolator I, size_t Lanes>
+  void gather(const Taps<T, Lanes>& taps, size_t base, size_t first, size_t count, T* output,
+              T& allpassState) const noexcept {
+    if constexpr (I == Interpolator::none) {
+      for (size_t frame = 0; frame < count; ++frame) {
+        output[frame] = sample((base + frame - taps.offset[first + frame]) & mask_);
+      }
+    } else if constexpr (I == Interpolator::linear) {
+      T y1[Lanes], y2[Lanes];
+      for (size_t frame = 0; frame < count; ++frame) {
+        auto index = base + frame - taps.offset[first + frame];
+        y1[frame] = sample(index & mask_);
+        y2[frame] = sample((index - 1) & mask_);
+      }
+      for (size_t frame = 0; frame < count; ++frame) {
+        output[frame] = taps.w1[first + frame] * y1[frame] + taps.w2[first + frame] * y2[frame];
+      }
+    } else if constexpr (I == Interpolator::cubic4thOrder) {
+      T y0[Lanes], y1[Lanes], y2[Lanes], y3[Lanes];
+      for (size_t frame = 0; frame < count; ++frame) {
+        auto index = base + frame - taps.offset[first + frame];
+        y0[frame] = sample((index + 1) & mask_);
+        y1[frame] = sample(index & mask_);
+        y2[frame] = sample((index - 1) & mask_);
+        y3[frame] = sample((index - 2) & mask_);
+      }
+      for (size_t frame = 0; frame < count; ++frame) {
+        auto lane = first + frame;
+        output[frame] = (taps.w0[lane] * y0[frame] + taps.w1[lane] * y1[frame] + taps.w2[lane] * y2[frame] +
+                         taps.w3[lane] * y3[frame]);
+      }
+    } else if constexpr (I == Interpolator::allpass) {
+      // The allpass filter is recursive so this loop is inherently serial.
+      auto state = allpassState;
+      for (size_t frame = 0; frame < count; ++frame) {
+        auto index = base + frame - taps.offset[first + frame];
+        auto coefficient = taps.w1[first + frame];
+        state = coefficient * (sample(index & mask_) - state) + sample((index - 1) & mask_);
+        output[frame] = state;
+      }
+      allpassState = state;
+    }
+  }
+
+  template <size_t Lanes>
+  T interpolate(const Taps<T, Lanes>& taps, size_t lane, size_t head) const noexcept {
+    auto index = head - taps.offset[lane];
+    return (taps.w0[lane] * sample((index + 1) & mask_) + taps.w1[lane] * sample(index & mask_) +
+            taps.w2[lane] * sample((index - 1) & mask_) + taps.w3[lane] * sample((index - 2) & mask_));
+  }
+
+  T sample(size_t index) const noexcept { return Codec::decode(buffer_[index]); }
+
+  S* buffer_{nullptr};
+  size_t capacity_{0};
+  size_t mask_{0};
+  size_t writePos_{0};
+  std::array<T, maxTaps> allpassState_{};
+  uint32_t ditherSeed_{22222};
+  T bias_{0};
+};
+
+/**
+ Owner of the samples used by a collection of delay lines. The storage is allocated once for the largest expected
+ configuration with `reserve`, after which `bind` only rearranges the `DelayLine` views into it. Only a request for more
+ lines or more samples than were reserved causes an allocation. Samples are held as `S` values.
+ */
+template <typename T, typename S = T>
+class DelayLinePool {
+public:
+
+  /**
+   Allocate storage for the given configuration. This always allocates so it must not be done on the render thread.
+   Any configured delay lines are released and `bind` must be called before using the pool again.
+
+   @param maxLineCount the max number of delay lines that will be used
+   @param maxSizeInSamples the max number of samples that a delay line will need to hold
+   */
+  void reserve(size_t maxLineCount, double maxSizeInSamples) {
+    lines_.clear();
+    lines_.reserve(maxLineCount);
+    storage_.assign(maxLineCount * lineSizeFor(maxSizeInSamples), S(0));
+  }
+
+  /**
+   Configure delay lines that hold at least the given number of samples. All delay lines are cleared.
+
+   @param lineCount the number of delay lines to make available
+   @param sizeInSamples the min number of samples that each delay line must hold
+   @returns true if the existing storage was used, false if storage had to be allocated
+   */
+  bool bind(size_t lineCount, double sizeInSamples) {
+    auto size = lineSizeFor(sizeInSamples);
+    bool reused = lineCount * size <= storage_.size() && lineCount <= lines_.capacity();
+    if (!reused) reserve(lineCount, sizeInSamples);
+
+    lines_.resize(lineCount);
+    for (size_t index = 0; index < lineCount; ++index) {
+      lines_[index].bind(storage_.data() + index * size, size);
+      lines_[index].clear();
+    }
+
+    return reused;
+  }
+
+  /// @returns the number of configured delay lines
+  size_t size() const noexcept { return lines_.size(); }
+
+  /// @returns true if there are no configured delay lines
+  bool empty() const noexcept { return lines_.empty(); }
+
+  /// @returns the total number of samples allocated for all delay lines
+  size_t capacity() const noexcept { return storage_.size(); }
+
+  DelayLine<T, S>& operator[](size_t index) noexcept { return lines_[index]; }
+
+  const DelayLine<T, S>& operator[](size_t index) const noexcept { return lines_[index]; }
+
+  /**
+   Obtain the number of samples a delay line will hold when asked to hold a given amount.
+
+   @param sizeInSamples the min number of samples to hold
+   @returns actual number of samples, always a power of 2
+   */
+  static size_t lineSizeFor(double sizeInSamples) noexcept {
+    return size_t(1) << size_t(std::ceil(std::log2(std::max(sizeInSamples, 8.0))));
+  }
+
+private:
+  std::vector<S> storage_;
+  std::vector<DelayLine<T, S>> lines_;
+};
+
+} // end namespace Chorus
@@ -0,0 +1,53 @@
+// Copyright © 2022 Brad Howes. All rights reserved.
+
+#pragma once
+
+#include <cstdint>
+
+#if defined(__SSE2__)
+#include <xmmintrin.h>
+#endif
+
+namespace Chorus {
+
+/**
+ Turns on flush-to-zero and denormals-are-zero in the floating-point unit of the current thread for as long as it
+ exists, and then puts back the previous mode. With them on, results and inputs that are too small to be normal floats
+ are treated as zero instead of going through the slow path that several CPUs use for them. Decaying audio in the
+ delay lines and the interpolation and mix calculations that use it would otherwise end up there.
+
+ On x86 this sets the FTZ and DAZ bits of MXCSR. On ARM64 there is one FZ bit in FPCR that does both.
+ */
+class DenormalGuard {
+public:
+  DenormalGuard() noexcept : saved_{get()} { set(saved_ | flags); }
+  ~DenormalGuard() noexcept { set(saved_); }
+
+  DenormalGuard(const DenormalGuard&) = delete;
+  DenormalGuard& operator=(const DenormalGuard&) = delete;
+
+private:
+#if defined(__SSE2__)
+  // FTZ is bit 15 and DAZ is bit 6 of MXCSR
+  static constexpr uint64_t flags = 0x8040;
+  static uint64_t get() noexcept { return _mm_getcsr(); }
+  static void set(uint64_t value) noexcept { _mm_setcsr(uint32_t(value)); }
+#elif defined(__aarch64__)
+  // FZ is bit 24 of FPCR
+  static constexpr uint64_t flags = uint64_t(1) << 24;
+  static uint64_t get() noexcept {
+    uint64_t value;
+    __asm__ __volatile__("mrs %0, fpcr" : "=r"(value));
+    return value;
+  }
+  static void set(uint64_t value) noexcept { __asm__ __volatile__("msr fpcr, %0" : : "r"(value)); }
+#else
+  static constexpr uint64_t flags = 0;
+  static uint64_t get() noexcept { return 0; }
+  static void set(uint64_t) noexcept {}
+#endif
+
+  uint64_t saved_;
+};
+
+} // end namespace Chorus
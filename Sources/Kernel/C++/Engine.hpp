@@ -0,0 +1,2061 @@
+// Copyright © 2021 Brad Howes. All rights reserved.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <type_traits>
+#include <vector>
+
+#include "DelayLine.hpp"
+#include "DenormalGuard.hpp"
+#include "KernelStorage.hpp"
+#include "QuadratureLFO.hpp"
+#include "RampingValue.hpp"
+#include "RenderStatistics.hpp"
+#include "TripleBuffer.hpp"
+#include "Types.hpp"
+#include "WorkerPool.hpp"
+
+namespace Chorus {
+
+/// The parameters of the engine. The values are the parameter addresses, which match those of `ParameterAddress`.
+enum class Parameter : Address {
+  rate = 0,
+  delay,
+  depth,
+  dry,
+  wet,
+  odd90,
+  quality,
+  voices,
+  feedback,
+  damping
+};
+
+/// The number of parameters. Their addresses run from 0 up to but not including this value.
+constexpr Address parameterCount = Address(Parameter::damping) + 1;
+
+/**
+ The rendering engine that generates a "chorus" effect by combining an audio signal with a slightly delayed copy of
+ itself. The delay value oscillates at a defined frequency which causes the delayed audio to vary in pitch due to it
+ being sped up or slowed down.
+
+ The engine is plain C++ that only depends on the standard library and the other headers here. It is told the sample
+ rate and channel count with `configure` or `setOfflineFormat`, and renders from plain sample buffers, so it can be
+ used and tested without AVFoundation or an audio unit host. `BasicKernel` adapts it to the audio unit render
+ protocol.
+
+ The audio going in and out is always made of `Value` samples, but the LFOs, the delay offsets, the interpolation and
+ mix calculations and the delay lines all work with `T` values. `double` keeps the LFO phases from drifting over very
+ long renders.
+
+ @param T the type to process samples with
+ @param Storage the policy that holds the per-frame work buffers -- `VectorStorage` or
+ `FixedStorage`
+ */
+template <typename T, typename Storage = VectorStorage>
+class Engine {
+public:
+
+  /**
+   Function that is told about each parameter change that the engine applies. It is called on the render thread, so it
+   must not block, allocate or log.
+
+   @param context the value given to `setParameterObserver`
+   @param sampleTime the sample time of the change
+   @param address the address of the parameter that changed
+   @param value the new value of the parameter
+   @param duration the number of frames to ramp to the new value
+   */
+  using ParameterObserver = void (*)(void* context, SampleTime sampleTime, Address address, Value value,
+                                     FrameCount duration);
+
+  /// The max number of parameter addresses that the engine can track. Addresses must be less than this value.
+  static constexpr size_t maxParameterCount = 16;
+  static_assert(parameterCount <= maxParameterCount, "too many parameters");
+
+  /// The max number of chorus voices. Every voice reads from the same delay line.
+  static constexpr size_t maxVoices = 8;
+
+  /// The max feedback percentage in either direction. Less than 100 so that the feedback always dies away.
+  static constexpr Value maxFeedback = 95.0;
+
+  /**
+   Allocate the delay lines and work buffers for the largest configuration the engine is expected to see. A later
+   `configure` that fits within these limits does not allocate any engine memory. Delay lines are allocated for both
+   storage types, so that a change made with `setCompactDelayLines` is also only a rebind.
+
+   @param maxChannelCount the max number of channels to support, counting the channels of every bus
+   @param maxSampleRate the max sample rate to support
+   @param maxFramesToRender the max number of samples we will be asked to render in one go
+   @param maxDelayMilliseconds the max number of milliseconds of audio samples to keep in delay buffer
+   */
+  void reserve(int maxChannelCount, double maxSampleRate, FrameCount maxFramesToRender,
+               double maxDelayMilliseconds) {
+    auto delayLineSize = delayLineSizeFor(maxSampleRate, maxDelayMilliseconds);
+    delayLines_.reserve(maxChannelCount, delayLineSize);
+    compactDelayLines_.reserve(maxChannelCount, delayLineSize);
+    for (auto vector : {&rampTap_, &rampDisplacement_, &rampWetMix_, &rampDryMix_, &rampFeedback_}) {
+      vector->reserve(maxFramesToRender);
+    }
+    feedbackLoops_.reserve(size_t(maxChannelCount));
+    segments_.reserve(maxFramesToRender);
+    evenDelays_.reserve(maxVoices * (maxFramesToRender + lanes));
+    oddDelays_.reserve(maxVoices * (maxFramesToRender + lanes));
+    evenTaps_.reserve(maxVoices * tapsCountFor(maxFramesToRender));
+    oddTaps_.reserve(maxVoices * tapsCountFor(maxFramesToRender));
+  }
+
+  /**
+   Choose how the delay lines hold their samples. Compact storage uses `CompactSample` values -- half-precision
+   floats where the compiler supports them, dithered 16-bit integers otherwise -- which halves the memory and the
+   memory bandwidth of the delay lines at the cost of some added noise in the wet signal. It is safe to call while
+   rendering: the choice takes effect with the next `configure` or `setOfflineFormat` call, which only rebinds the
+   delay lines if `reserve` allocated enough for the format.
+
+   @param enabled true to use compact storage. It is off by default.
+   */
+  void setCompactDelayLines(bool enabled) noexcept { compactStorage_.store(enabled, std::memory_order_relaxed); }
+
+  /// @returns true if compact storage was chosen by the last `setCompactDelayLines` call
+  bool compactDelayLines() const noexcept { return compactStorage_.load(std::memory_order_relaxed); }
+
+  /**
+   Add a tiny DC offset to the samples written to the delay lines. Rendering always runs with flush-to-zero on, but
+   this also keeps the values out of the denormal range when something else turns it off. The offset is 1e-20, about
+   400 dB down, so it cannot be heard. It only applies to full-precision delay lines -- compact storage cannot hold a
+   value that small, nor anything that decodes to a denormal, so it does without. Must not be changed while rendering.
+
+   @param enabled true to add the offset
+   */
+  void setDenormalBias(bool enabled) noexcept {
+    denormalBias_ = enabled;
+    applyDenormalBias(delayLines_);
+    applyDenormalBias(compactDelayLines_);
+  }
+
+  /// @returns true if a DC offset is added to the samples written to the delay lines
+  bool denormalBias() const noexcept { return denormalBias_; }
+
+  /**
+   Update the engine and its buffers to render the given format and channel count.
+
+   @param busCount the number of busses to support. Each bus has the same number of channels.
+   @param channelCount the number of channels in each bus
+   @param sampleRate the sample rate of the audio to render
+   @param maxFramesToRender the maximum number of samples we will be asked to render in one go. With fixed storage
+   this is limited to what the work buffers hold -- see `maxFramesToRender()`.
+   @param maxDelayMilliseconds the max number of milliseconds of audio samples to keep in delay buffer
+   */
+  void configure(int busCount, int channelCount, double sampleRate, FrameCount maxFramesToRender,
+                 double maxDelayMilliseconds) {
+    if constexpr (storageFrames > 0) {
+      maxFramesToRender = std::min(maxFramesToRender, FrameCount(storageFrames));
+    }
+
+    samplesPerMillisecond_ = sampleRate / 1000.0;
+    activeCompact_ = compactDelayLines();
+    busCount_ = size_t(std::max(busCount, 1));
+    channelCount_ = size_t(channelCount);
+    maxFramesToRender_ = maxFramesToRender;
+    offlineInputs_.resize(channelCount_);
+    offlineOutputs_.resize(channelCount_);
+    cycleSampleTime_ = -1.0;
+    silentFrames_ = 0;
+
+    // Per-frame coefficient vectors used when rendering parameter ramps. The mix values are kept for the whole render
+    // cycle so that other busses can use them, but a render cycle never spans more than `maxFramesToRender` frames.
+    rampTap_.resize(maxFramesToRender);
+    rampDisplacement_.resize(maxFramesToRender);
+    rampWetMix_.resize(maxFramesToRender);
+    rampDryMix_.resize(maxFramesToRender);
+    rampFeedback_.resize(maxFramesToRender);
+
+    // Every segment has at least one frame, so there is room to record all of the segments of a render cycle.
+    segments_.resize(maxFramesToRender);
+
+    // Per-frame delay offsets for each voice, calculated once per render cycle and shared by all channels of all
+    // busses. There is always room for one more full set of lanes, which is what a static delay uses.
+    delaysStride_ = maxFramesToRender + lanes;
+    evenDelays_.resize(maxVoices * delaysStride_);
+    oddDelays_.resize(maxVoices * delaysStride_);
+    evenTaps_.resize(maxVoices * tapsCountFor(maxFramesToRender));
+    oddTaps_.resize(maxVoices * tapsCountFor(maxFramesToRender));
+
+    auto rate{rate_.get()};
+    auto controlInterval = controlIntervalFor(sampleRate);
+    for (size_t voice = 0; voice < maxVoices; ++voice) {
+      lfos_[voice].setSampleRate(sampleRate);
+      lfos_[voice].setFrequency(rate * voiceRateScale(voice), 0);
+      lfos_[voice].setControlInterval(controlInterval);
+    }
+    spreadVoicePhases();
+    updateDampingCoefficient();
+    feedbackLoops_.assign(busCount_ * channelCount_, FeedbackLoop{});
+
+    auto size = delayLineSizeFor(sampleRate, maxDelayMilliseconds);
+    // Each bus has its own set of delay lines, held by the pool for the chosen storage type. The other pool keeps
+    // its memory for when the storage changes again.
+    if (activeCompact_) {
+      bindDelayLines(compactDelayLines_, size);
+    } else {
+      bindDelayLines(delayLines_, size);
+    }
+  }
+
+  /// @returns the maximum number of frames that can be rendered in one go
+  FrameCount maxFramesToRender() const noexcept { return maxFramesToRender_; }
+
+  /// @returns the number of busses being rendered
+  size_t busCount() const noexcept { return busCount_; }
+
+  /// @returns the number of channels in each bus
+  size_t channelCount() const noexcept { return channelCount_; }
+
+  /// @returns the sample rate being rendered
+  double sampleRate() const noexcept { return samplesPerMillisecond_ * 1000.0; }
+
+  /// @returns true if the last `configure` had to grow the delay line storage
+  bool delayLinesGrew() const noexcept { return delayLinesGrew_; }
+
+  /**
+   Obtain the number of samples the delay lines hold for a sample rate and max delay.
+
+   @param sampleRate the sample rate being rendered
+   @param maxDelayMilliseconds the max number of milliseconds of audio samples to keep in delay buffer
+   @returns number of samples
+   */
+  static double delayLineSizeFor(double sampleRate, double maxDelayMilliseconds) noexcept {
+    // Size of delay buffer needs to be twice the maxDelay value since at max delay and max depth settings, the bipolar
+    // indices into the delay buffer will go from delay * -1 * depth to delay * 1 * depth (approximately). Also make
+    // room for one block of `lanes` samples that is written before it is read.
+    return maxDelayMilliseconds * sampleRate / 1000.0 * 2.0 + 1 + lanes + 3;
+  }
+
+  /**
+   Configure the engine for rendering with `renderOffline` or `renderOfflineInterleaved`, without going through an
+   audio unit render block.
+
+   @param channelCount the number of channels to render
+   @param sampleRate the sample rate of the audio to render
+   @param maxFramesToRender the number of frames to render at a time. Offline renders of any length are split into
+   chunks of this size.
+   @param maxDelayMilliseconds the max number of milliseconds of audio samples to keep in delay buffer
+   */
+  void setOfflineFormat(int channelCount, double sampleRate, FrameCount maxFramesToRender,
+                        double maxDelayMilliseconds) {
+    configure(1, channelCount, sampleRate, maxFramesToRender, maxDelayMilliseconds);
+  }
+
+  /**
+   Start worker threads that render groups of channels in parallel with the render thread when there are at least
+   `minChannelCount` channels in a bus. The delay offsets and interpolation settings are still calculated once per
+   block on the render thread, and all workers are done before the render call returns. Must not be called while
+   rendering.
+
+   @param workerCount the number of worker threads to start. Use 0 to render all channels on the render thread.
+   @param minChannelCount the smallest channel count that is rendered in parallel
+   @param workgroup the audio workgroup of the render thread for the workers to join, or nullptr
+   */
+  void setRenderWorkers(size_t workerCount, size_t minChannelCount = 8,
+                        WorkerPool::Workgroup workgroup = nullptr) {
+    workers_.start(workerCount, workgroup);
+    parallelChannelCount_ = std::max<size_t>(minChannelCount, 2);
+  }
+
+  /// @returns the number of worker threads that help with rendering
+  size_t renderWorkerCount() const noexcept { return workers_.size(); }
+
+  /// A parameter change at a specific frame of an offline render.
+  struct AutomationEvent {
+    /// The frame, counting from the first frame of the render, at which the change is applied
+    SampleTime sampleTime;
+    Address address;
+    Value value;
+    /// The number of frames to ramp to the new value
+    FrameCount rampDuration;
+  };
+
+  /**
+   Render any number of frames from planar buffers without an audio unit host. Rendering is split into chunks of
+   `maxFramesToRender` frames, and further split at each automation event. Changes posted by `postParameterValue` are
+   applied first. Must not be used at the same time as `processAndRender`.
+
+   @param inputs one buffer per channel with the samples to process
+   @param outputs one buffer per channel to hold the rendered samples. These may be the same as `inputs`.
+   @param frameCount the number of frames to render
+   @param events parameter changes to apply during the render, ordered by `sampleTime`
+   @param eventCount the number of entries in `events`
+   */
+  void renderOffline(const Value* const* inputs, Value* const* outputs, size_t frameCount,
+                     const AutomationEvent* events = nullptr, size_t eventCount = 0) noexcept {
+    assert(maxFramesToRender_ > 0);
+    applyPostedParameterValues();
+    size_t eventIndex = 0;
+    for (size_t position = 0; position < frameCount; position += maxFramesToRender_) {
+      auto chunk = FrameCount(std::min<size_t>(maxFramesToRender_, frameCount - position));
+      for (size_t channel = 0; channel < channelCount_; ++channel) {
+        offlineInputs_[channel] = const_cast<Value*>(inputs[channel]) + position;
+        offlineOutputs_[channel] = outputs[channel] + position;
+      }
+      renderOfflineChunk(position, chunk, events, eventCount, eventIndex);
+    }
+  }
+
+  /**
+   Render any number of frames from interleaved buffers without an audio unit host. Same as `renderOffline` but the
+   samples of each frame are next to each other. The samples are read and written in place without first converting
+   them to planar buffers.
+
+   @param input the interleaved samples to process
+   @param output the buffer to hold the interleaved rendered samples. This may be the same as `input`.
+   @param frameCount the number of frames to render
+   @param events parameter changes to apply during the render, ordered by `sampleTime`
+   @param eventCount the number of entries in `events`
+   */
+  void renderOfflineInterleaved(const Value* input, Value* output, size_t frameCount,
+                                const AutomationEvent* events = nullptr, size_t eventCount = 0) noexcept {
+    assert(maxFramesToRender_ > 0);
+    applyPostedParameterValues();
+    size_t eventIndex = 0;
+    interleaved_ = true;
+    for (size_t position = 0; position < frameCount; position += maxFramesToRender_) {
+      auto chunk = FrameCount(std::min<size_t>(maxFramesToRender_, frameCount - position));
+      interleavedInput_ = input + position * channelCount_;
+      interleavedOutput_ = output + position * channelCount_;
+      renderOfflineChunk(position, chunk, events, eventCount, eventIndex);
+    }
+    interleaved_ = false;
+  }
+
+  /**
+   Turn on or off the recording of render statistics. It is off by default.
+
+   @param enabled true if statistics should be recorded
+   */
+  void setInstrumentationEnabled(bool enabled) noexcept {
+    instrumentationEnabled_.store(enabled, std::memory_order_relaxed);
+  }
+
+  /// @returns true if render statistics are being recorded
+  bool isInstrumentationEnabled() const noexcept { return instrumentationEnabled_.load(std::memory_order_relaxed); }
+
+  /// @returns the render statistics recorded while instrumentation is enabled
+  const RenderStatistics& renderStatistics() const noexcept { return statistics_; }
+
+  /// Clear the recorded render statistics
+  void resetRenderStatistics() noexcept { statistics_.reset(); }
+
+  /**
+   Post an AU parameter value change from a thread other than the render thread. The change is applied at the start
+   of the next render call. Each parameter has one slot for its latest posted value, so several changes to the same
+   parameter that arrive between render calls are coalesced and only the last one is applied. Nothing is ever dropped,
+   no matter how many changes arrive before the render thread runs.
+
+   @param address the address of the parameter that changed
+   @param value the new value for the parameter
+   @returns false if there is no parameter at the address
+   */
+  bool postParameterValue(Address address, Value value) noexcept {
+    if (address >= maxParameterCount) return false;
+    postedValues_[address].store(value, std::memory_order_relaxed);
+    postedSequences_[address].fetch_add(1, std::memory_order_release);
+    postedChanges_.fetch_or(uint32_t(1) << address, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   Obtain the value of an AU parameter from a thread other than the render thread. If there is a change to the
+   parameter that has not yet been applied by the render thread, the value of that change is returned.
+
+   @param address the address of the parameter to return
+   @returns latest parameter value
+   */
+  Value getPostedParameterValue(Address address) const noexcept {
+    if (address < maxParameterCount && postedSequences_[address].load(std::memory_order_acquire) !=
+        appliedSequences_[address].load(std::memory_order_acquire)) {
+      return postedValues_[address].load(std::memory_order_relaxed);
+    }
+    return getParameterValue(address);
+  }
+
+  /**
+   Set the bypass state. Instead of switching straight to the input signal, the engine first lets the wet signal of the
+   audio it has already taken in play out -- for the span of the delay lines in use, once for each trip around the
+   feedback loop it takes to fall 60 dB -- while the delay lines are fed silence. After that it no longer renders, and
+   only copies the input to the output. When bypass is turned off, the delay lines are cleared so that no stale audio
+   is heard. Safe to call from any thread -- the change is picked up at the start of the next render call.
+
+   @param bypass true to bypass the effect
+   */
+  void setBypass(bool bypass) noexcept { bypassRequested_.store(bypass, std::memory_order_relaxed); }
+
+  /// @returns true if bypass has been requested
+  bool isBypassed() const noexcept { return bypassRequested_.load(std::memory_order_relaxed); }
+
+  /// @returns true if bypassed and the tail has drained, so that rendering does nothing but copy the input
+  bool isBypassIdle() const noexcept { return bypassState_ == BypassState::bypassed; }
+
+  /// @returns true if the input has been silent for longer than the span of the delay lines -- times the number of
+  /// trips around the feedback loop it takes to fall 120 dB -- so that rendering only advances the LFOs
+  bool isSilenceIdle() const noexcept { return silentFrames_ > silenceSpan(); }
+
+  /**
+   Obtain the time it takes for the output to settle after the input becomes silent: the longest delay that the
+   current delay and depth settings can read, plus the time it takes the feedback to fall 60 dB.
+
+   @returns tail time in seconds
+   */
+  double tailTime() const noexcept {
+    auto depth = std::clamp<double>(depth_.get() / 100.0, 0.0, 1.0);
+    auto delay = delay_.get() * (1.0 + depth) / 1000.0;
+    // A trip around the feedback loop takes the delay, but the shortest trip is two frames.
+    auto trip = std::max(delay, 2.0 / (samplesPerMillisecond_ * 1000.0));
+    return delay + feedbackTrips(1.0E-3) * trip;
+  }
+
+  /// A complete set of parameter values that is applied by the render thread in one step.
+  struct Preset {
+    Value rate;
+    Value delay;
+    Value depth;
+    Value dry;
+    Value wet;
+    Value odd90;
+    Value quality;
+    Value voices;
+    Value feedback;
+    Value damping;
+    /// The number of frames over which to crossfade to the new settings, or 0 to switch at once
+    FrameCount crossfadeFrames;
+  };
+
+  /**
+   Post a preset from a thread other than the render thread. It is applied at the start of the next render call,
+   before any changes posted by `postParameterValue`. Publishing is a single atomic pointer swap, so the render thread
+   never sees a partial preset. If several presets are posted between render calls only the last one is applied. Only
+   one thread may post presets.
+
+   With a crossfade, the dry mix ramps to its new value over the whole crossfade while the wet signal fades out with
+   an equal-power curve, switches to all of the other new settings at the midpoint, and fades back in. Discrete
+   settings such as the voice count thus change while the wet signal is silent.
+
+   Until the render thread has switched to them, `getPostedParameterValue` returns the values of the preset, so that
+   the AU parameters can be brought in line with the preset without posting each value again.
+
+   @param preset the values to apply
+   */
+  void postPreset(const Preset& preset) noexcept {
+    // No change bits are set: applying the preset sets the values.
+    auto values = presetValues(preset);
+    for (Address address = 0; address < parameterCount; ++address) {
+      postedValues_[address].store(values[address], std::memory_order_relaxed);
+      postedSequences_[address].fetch_add(1, std::memory_order_release);
+    }
+    presets_.publish(preset);
+  }
+
+  /**
+   Process an AU parameter value change by updating the engine.
+
+   @param address the address of the parameter that changed
+   @param value the new value for the parameter
+   @param rampDuration number of frames to ramp to the new value
+   */
+  void setParameterValue(Address address, Value value, FrameCount rampDuration) noexcept {
+    // NOTE: this is called on the render thread so it must not log -- nor may the observer.
+    if (observer_ != nullptr) observer_(observerContext_, sampleTime_, address, value, rampDuration);
+    static constexpr auto setters = makeSetters();
+    static_assert(isComplete(setters), "a parameter has no setter");
+    if (address < parameterCount) setters[address](*this, value, rampDuration);
+  }
+
+  /// A new value for one parameter.
+  struct ParameterValue {
+    Address address;
+    Value value;
+    /// The number of frames to ramp to the new value
+    FrameCount rampDuration;
+  };
+
+  /**
+   Apply several parameter value changes in one go, such as all of the changes for one sample time. This is the same
+   as calling `setParameterValue` for each of them in order.
+
+   @param values the changes to apply
+   @param count the number of entries in `values`
+   */
+  void setParameters(const ParameterValue* values, size_t count) noexcept {
+    for (size_t index = 0; index < count; ++index) {
+      setParameterValue(values[index].address, values[index].value, values[index].rampDuration);
+    }
+  }
+
+  /**
+   Obtain from the engine the current value of an AU parameter.
+
+   @param address the address of the parameter to return
+   @returns current parameter value, or 0 if there is no parameter at the address
+   */
+  Value getParameterValue(Address address) const noexcept {
+    static constexpr auto getters = makeGetters();
+    static_assert(isComplete(getters), "a parameter has no getter");
+    return address < parameterCount ? getters[address](*this) : 0.0;
+  }
+
+  /**
+   Install a function to be told about each parameter change that is applied, such as for tracing. Must not be called
+   while rendering.
+
+   @param observer the function to call, or nullptr to stop
+   @param context the value to give to `observer`
+   */
+  void setParameterObserver(ParameterObserver observer, void* context) noexcept {
+    observer_ = observer;
+    observerContext_ = context;
+  }
+
+protected:
+
+  /**
+   Set the sample time to report with the parameter changes that follow.
+
+   @param sampleTime the sample time of the next change
+   */
+  void setEventSampleTime(SampleTime sampleTime) noexcept { sampleTime_ = sampleTime; }
+
+  /// @returns true if the bus being rendered replays the render cycle of another bus
+  bool isReplaying() const noexcept { return replaying_; }
+
+  /// @returns the number of frames of the current render call that were skipped because they could only be silent
+  FrameCount skippedFrames() const noexcept { return skippedFrames_; }
+
+  /**
+   Record the time it took to render.
+
+   @param frameCount the number of frames rendered
+   @param nanoseconds the time taken
+   */
+  void recordRender(FrameCount frameCount, uint64_t nanoseconds) noexcept {
+    auto deadline = uint64_t(frameCount / (samplesPerMillisecond_ * 1000.0) * 1.0E9);
+    statistics_.recordRender(frameCount, nanoseconds, deadline);
+  }
+
+  /**
+   Set up for rendering a bus. The first bus rendered for a timestamp leads the render cycle: it applies the parameter
+   changes, advances the LFOs and records the control data of each segment it renders. Any other bus rendered for the
+   same timestamp replays those segments with its own delay lines.
+
+   @param sampleTime the sample time of the first frame to render
+   @param bus the bus being rendered
+   */
+  void beginCycle(double sampleTime, size_t bus) noexcept {
+    delayLineBase_ = size_t(bus) * channelCount_;
+    cycleOffset_ = 0;
+    skippedFrames_ = 0;
+    replayIndex_ = 0;
+    replayOffset_ = 0;
+    replaying_ = busCount_ > 1 && sampleTime == cycleSampleTime_ && bus != cycleLeader_;
+    if (!replaying_) {
+      cycleSampleTime_ = sampleTime;
+      cycleLeader_ = bus;
+      segmentCount_ = 0;
+      updateBypassState();
+
+      // Shrink the delay lines between render cycles so that every bus renders a cycle with the same ring.
+      if (spanShrinkPending_) updateDelayLineSpan(true);
+    }
+  }
+
+  /**
+   Apply the changes posted by `postParameterValue` since the last render call. Only the last change for each
+   parameter is applied.
+   */
+  void applyPostedParameterValues() noexcept {
+    if (auto preset = presets_.take()) applyPreset(*preset);
+
+    // A change posted while this runs sets its bit again, so at worst it is applied twice.
+    auto changes = postedChanges_.exchange(0, std::memory_order_acquire);
+    for (Address address = 0; changes != 0; ++address, changes >>= 1) {
+      if ((changes & 1) == 0) continue;
+      auto sequence = postedSequences_[address].load(std::memory_order_acquire);
+      setParameterValue(address, postedValues_[address].load(std::memory_order_relaxed), 0);
+      appliedSequences_[address].store(sequence, std::memory_order_release);
+    }
+  }
+
+  /**
+   Render frames of the bus set up by `beginCycle`. Consecutive calls render consecutive frames of the render cycle.
+
+   @param ins the input sample buffers. The pointers are moved past the frames that are rendered.
+   @param outs the output sample buffers. The pointers are moved past the frames that are rendered.
+   @param frameCount the number of frames to render
+   */
+  void render(ChannelBuffers ins, ChannelBuffers outs, FrameCount frameCount) noexcept {
+    if (bypassState_ == BypassState::bypassed) {
+      renderBypassed(frameCount, ins, outs);
+      return;
+    }
+
+    if (bypassState_ == BypassState::draining && !replaying_) {
+      drainRemaining_ -= std::min(drainRemaining_, frameCount);
+    }
+
+    if (replaying_) {
+      frameCount = replaySegments(frameCount, ins, outs);
+
+      // Only get here if this bus renders more frames than the leading bus did.
+      if (frameCount > 0) renderUnrecorded(frameCount, ins, outs);
+      return;
+    }
+
+    // While parameters are ramping, split the frames where each ramp ends. Each ramp segment generates per-frame
+    // values only for the parameters that are ramping in it and then renders them in one pass.
+    while (frameCount > 0) {
+      auto rampCount = ramps_.next(frameCount);
+      if (rampCount == 0) {
+        if (!renderSilence(frameCount, ins, outs)) renderFrames(frameCount, ins, outs);
+        break;
+      }
+
+      if (instrumentationEnabled_.load(std::memory_order_relaxed)) statistics_.recordRamp(rampCount);
+      renderRampingFrames(rampCount, ins, outs);
+      auto spanWasRamping = ramps_.modulation();
+      ramps_.advance(rampCount);
+      if (spanWasRamping && !ramps_.modulation()) updateDelayLineSpan();
+      advanceCrossfade();
+      frameCount -= rampCount;
+    }
+  }
+
+private:
+  using DelayLine = Chorus::DelayLine<T>;
+  using LFO = QuadratureLFO<T>;
+
+  /// Number of frames that share one set of cubic interpolation settings.
+  static constexpr FrameCount lanes = 8;
+  using Taps = Chorus::Taps<T, lanes>;
+
+  /// The max number of frames the work buffers hold, or 0 if they grow to fit any render size
+  static constexpr size_t storageFrames = Storage::maxFrames;
+  template <typename V, size_t Capacity>
+  using Buffer = typename Storage::template Buffer<V, Capacity>;
+  static_assert(maxVoices <= DelayLine::maxTaps, "too many voices for DelayLine");
+
+  /// The ways to render a block of frames with steady parameter values, from cheapest to most expensive.
+  enum class RenderMode {
+    /// No wet signal -- the output is the scaled input
+    passthrough,
+    /// No LFO modulation -- every frame reads from the delay lines at the same delay
+    staticDelay,
+    /// Every frame reads from the delay lines at its own delay
+    chorus
+  };
+
+  /// Description of a run of frames rendered with the same settings. The per-frame control data for the segment is
+  /// found at the segment's offset in the render cycle.
+  struct Segment {
+    FrameCount frameCount;
+    RenderMode mode;
+    /// True if the per-frame wet and dry mix values are used
+    bool ramping;
+    Interpolator interpolator;
+    bool odd90;
+    size_t voiceCount;
+    /// The delay of every frame of a static delay. Other modes take their delays from the render cycle.
+    T tap;
+    T wetMix;
+    T dryMix;
+    /// The share of the wet signal fed back into the delay lines when not ramping
+    T feedback;
+    /// True if the feedback path is in use
+    bool recirculating;
+    /// True if bypass is draining the tail: the delay lines take in silence and the input goes out unscaled
+    bool draining;
+  };
+
+  enum class BypassState {
+    /// Rendering the effect
+    active,
+    /// Bypassed, but the wet signal of the audio taken in before the bypass is still playing out
+    draining,
+    /// Bypassed with nothing left to play out
+    bypassed
+  };
+
+  /// The number of frames left in the ramp of each parameter that is rendered from per-frame values. The rate is not
+  /// here since the LFOs ramp their own frequency.
+  struct RampCounts {
+    FrameCount delay{0};
+    FrameCount depth{0};
+    FrameCount wetMix{0};
+    FrameCount dryMix{0};
+    FrameCount feedback{0};
+    /// Frames left in the current phase of a preset crossfade
+    FrameCount crossfade{0};
+
+    /// @returns true if the delay or depth is ramping, and thus the span of the delays read from the delay lines
+    bool modulation() const noexcept { return delay > 0 || depth > 0; }
+
+    /// @returns the number of frames, up to `limit`, until the next ramp ends, or 0 if nothing is ramping
+    FrameCount next(FrameCount limit) const noexcept {
+      FrameCount count = 0;
+      for (auto remaining : {delay, depth, wetMix, dryMix, feedback, crossfade}) {
+        if (remaining > 0) count = count == 0 ? remaining : std::min(count, remaining);
+      }
+      return std::min(count, limit);
+    }
+
+    /// Account for `count` frames having been rendered
+    void advance(FrameCount count) noexcept {
+      for (auto remaining : {&delay, &depth, &wetMix, &dryMix, &feedback, &crossfade}) {
+        *remaining -= std::min(*remaining, count);
+      }
+    }
+  };
+
+  /// State of a crossfade to a new preset.
+  struct Crossfade {
+    Preset preset;
+    FrameCount length;
+    /// The number of frames of the crossfade rendered so far
+    FrameCount position;
+    /// True once the settings other than the dry mix have switched to those of the preset
+    bool switched;
+    bool active;
+  };
+
+  static_assert((lanes & (lanes - 1)) == 0, "lanes must be a power of 2");
+
+  /**
+   The feedback path of one delay line. The wet signal read from the delay line goes through the damping filter -- a
+   one-pole low-pass that costs one multiply-add per sample -- and is added to the input of the same frame as it is
+   written (see `DelayLine::processFeedback`), so the trip around the loop takes the delay and not the block size.
+   */
+  struct FeedbackLoop {
+    T lowpass{0.0};
+  };
+
+  /**
+   One block of a feedback loop, with the `take` and `feed` calls that `DelayLine::processFeedback` makes.
+
+   @param V the type of the input samples
+   */
+  template <typename V>
+  struct FeedbackBlock {
+    FeedbackLoop& loop;
+    /// The input samples of the block
+    const V* input;
+    /// The feedback gain of each frame, or nullptr to use `gain` for all of them
+    const T* gains;
+    T gain;
+    /// The damping filter coefficient. 1 means no damping.
+    T coefficient;
+
+    void take(size_t, T delayed) noexcept { loop.lowpass += coefficient * (delayed - loop.lowpass); }
+
+    T feed(size_t frame) const noexcept {
+      return T(input[frame]) + (gains != nullptr ? gains[frame] : gain) * loop.lowpass;
+    }
+  };
+
+  /**
+   Obtain the samples of a block that go into a delay line without feedback.
+
+   @param segment the description of the segment being rendered
+   @param input the input samples of the block
+   @param count the number of frames in the block
+   @param buffer space for up to `lanes` samples
+   @returns the samples to write to the delay line
+   */
+  template <typename V>
+  static const T* delayLineInput(const Segment& segment, const V* input, size_t count, T* buffer) noexcept {
+    // While a bypass drains, the delay lines take in silence so that only the audio already in them plays out.
+    static constexpr T silence[lanes]{};
+    if (segment.draining) return silence;
+    if constexpr (std::is_same_v<V, T>) {
+      return input;
+    } else {
+      std::copy_n(input, count, buffer);
+      return buffer;
+    }
+  }
+
+  /**
+   Write a block to a delay line and read its taps, going through the feedback loop of the delay line if it is in use.
+
+   @param delayLine the delay line to use
+   @param loop the feedback path of the delay line
+   @param segment the description of the segment being rendered
+   @param offset the offset of the block in the segment
+   @param input the input samples of the block
+   @param taps the interpolation settings of each voice
+   @param voiceCount the number of voices to read and sum for each frame
+   @param count the number of frames in the block
+   @param delayed the destination for the samples read
+   */
+  template <Interpolator I, typename D, typename V>
+  void processBlock(D& delayLine, FeedbackLoop& loop, const Segment& segment, FrameCount offset, const V* input,
+                    const Taps* taps, size_t voiceCount, size_t count, T* delayed) noexcept {
+    if (!segment.recirculating) {
+      T buffer[lanes];
+      delayLine.template process<I>(delayLineInput(segment, input, count, buffer), taps, voiceCount, count, delayed);
+      return;
+    }
+
+    static constexpr T silence[lanes]{};
+    auto gains = segment.ramping ? rampFeedback_.data() + cycleOffset_ + offset : nullptr;
+    if (segment.draining) {
+      FeedbackBlock<T> block{loop, silence, gains, segment.feedback, dampingCoefficient_};
+      delayLine.template processFeedback<I>(taps, voiceCount, count, delayed, block);
+    } else {
+      FeedbackBlock<V> block{loop, input, gains, segment.feedback, dampingCoefficient_};
+      delayLine.template processFeedback<I>(taps, voiceCount, count, delayed, block);
+    }
+  }
+
+  /**
+   Configure the delay lines of every bus in the given pool and remember the largest delay they can be read at.
+
+   @param pool the pool to use
+   @param size the min number of samples each delay line must hold
+   */
+  template <typename Pool>
+  void bindDelayLines(Pool& pool, double size) {
+    delayLinesGrew_ = !pool.bind(busCount_ * channelCount_, size);
+    maxTapDelay_ = pool.empty() ? T(1.0) : pool[0].maxDelay(lanes);
+    spanShrinkPending_ = false;
+    resizeDelayLines(pool, true);
+    applyDenormalBias(pool);
+  }
+
+  template <typename Pool>
+  void applyDenormalBias(Pool& pool) noexcept {
+    // The bias would round to zero in compact storage, which has no denormals to avoid anyway.
+    auto bias = denormalBias_ && std::is_same_v<Pool, DelayLinePool<T>> ? T(1.0E-20) : T(0.0);
+    for (size_t index = 0; index < pool.size(); ++index) pool[index].setBias(bias);
+  }
+
+  /**
+   Fit the active part of the delay lines to the span of delays that the current delay and depth settings can read.
+   Each delay line keeps all of the storage it was given -- which is sized for `maxDelayMilliseconds` -- but only works
+   with the smallest power of 2 above the span so that it stays in cache for short delays. A longer span grows the
+   lines at once. A shorter one only shrinks them once no parameter is ramping and the lines are at least four times
+   larger than needed, so that small changes do not move samples around.
+
+   @param shrink true if the lines may shrink now. Otherwise a shrink waits for the start of the next render cycle:
+   the other busses still have to replay the frames the leading bus rendered with the larger lines, and shrinking
+   rearranges the samples of every bus.
+   */
+  void updateDelayLineSpan(bool shrink = false) noexcept {
+    spanShrinkPending_ = false;
+    shrink = shrink || busCount_ == 1;
+    if (activeCompact_) {
+      resizeDelayLines(compactDelayLines_, shrink);
+    } else {
+      resizeDelayLines(delayLines_, shrink);
+    }
+  }
+
+  template <typename Pool>
+  void resizeDelayLines(Pool& pool, bool shrink) noexcept {
+    if (pool.empty()) return;
+
+    // The delay in samples plus the largest LFO displacement, and room for a block of lanes and the cubic
+    // interpolation reads.
+    auto depth = std::clamp<double>(depth_.get() / 100.0, 0.0, 1.0);
+    auto span = delay_.get() * samplesPerMillisecond_ * (1.0 + depth) + lanes + 4;
+    auto capacity = pool[0].capacity();
+    auto size = pool[0].size();
+    auto wanted = std::min(Pool::lineSizeFor(span), capacity);
+    if (wanted > size) {
+      size = wanted;
+    } else if (!ramps_.modulation() && wanted * 4 <= size) {
+      if (!shrink) {
+        spanShrinkPending_ = true;
+        return;
+      }
+      size = wanted * 2;
+    } else {
+      return;
+    }
+
+    for (size_t index = 0; index < pool.size(); ++index) {
+      pool[index].resize(size);
+    }
+    maxTapDelay_ = pool[0].maxDelay(lanes);
+  }
+
+  /// @returns the pool of delay lines that hold samples of type `S`
+  template <typename S>
+  auto& delayLines() noexcept {
+    if constexpr (std::is_same_v<S, T>) {
+      return delayLines_;
+    } else {
+      return compactDelayLines_;
+    }
+  }
+
+  /**
+   Obtain the number of frames between LFO evaluations for a sample rate. The fastest LFO rate is 20 Hz, so even at
+   4 frames per evaluation at 192 kHz the interpolation error is well under one millionth of the LFO range.
+
+   @param sampleRate the sample rate being rendered
+   @returns number of frames between evaluations
+   */
+  static size_t controlIntervalFor(double sampleRate) noexcept {
+    if (sampleRate > 128000.0) return 4;
+    if (sampleRate > 64000.0) return 2;
+    return 1;
+  }
+
+  static size_t tapsCountFor(FrameCount frameCount) noexcept { return (frameCount + lanes - 1) / lanes; }
+
+  using Setter = void (*)(Engine& engine, Value value, FrameCount duration) noexcept;
+  using Getter = Value (*)(const Engine& engine) noexcept;
+
+  template <typename Table>
+  static constexpr bool isComplete(const Table& table) noexcept {
+    for (auto entry : table) if (entry == nullptr) return false;
+    return true;
+  }
+
+  /**
+   Build the table of the functions that set a parameter, indexed by parameter address. Each ramping parameter keeps
+   its own ramp count so that only the parameters that are ramping are stepped per frame.
+
+   @returns the table
+   */
+  static constexpr std::array<Setter, parameterCount> makeSetters() noexcept {
+    std::array<Setter, parameterCount> table{};
+    table[size_t(Parameter::rate)] = [](Engine& engine, Value value, FrameCount duration) noexcept {
+      engine.setRate(value, duration);
+    };
+    table[size_t(Parameter::delay)] = [](Engine& engine, Value value, FrameCount duration) noexcept {
+      engine.delay_.set(value, duration);
+      engine.ramps_.delay = duration;
+      engine.updateDelayLineSpan();
+    };
+    table[size_t(Parameter::depth)] = [](Engine& engine, Value value, FrameCount duration) noexcept {
+      engine.depth_.set(value, duration);
+      engine.ramps_.depth = duration;
+      engine.updateDelayLineSpan();
+    };
+    table[size_t(Parameter::dry)] = [](Engine& engine, Value value, FrameCount duration) noexcept {
+      engine.dryMix_.set(value, duration);
+      engine.ramps_.dryMix = duration;
+    };
+    table[size_t(Parameter::wet)] = [](Engine& engine, Value value, FrameCount duration) noexcept {
+      engine.wetMix_.set(value, duration);
+      engine.ramps_.wetMix = duration;
+    };
+    table[size_t(Parameter::odd90)] = [](Engine& engine, Value value, FrameCount) noexcept {
+      engine.odd90_ = value >= 0.5;
+    };
+    table[size_t(Parameter::quality)] = [](Engine& engine, Value value, FrameCount) noexcept {
+      engine.setQuality(value);
+    };
+    table[size_t(Parameter::voices)] = [](Engine& engine, Value value, FrameCount) noexcept {
+      engine.setVoices(value);
+    };
+    table[size_t(Parameter::feedback)] = [](Engine& engine, Value value, FrameCount duration) noexcept {
+      engine.feedback_.set(std::clamp<Value>(value, -maxFeedback, maxFeedback), duration);
+      engine.ramps_.feedback = duration;
+    };
+    table[size_t(Parameter::damping)] = [](Engine& engine, Value value, FrameCount) noexcept {
+      engine.damping_ = std::clamp<Value>(value, 0.0, 100.0);
+      engine.updateDampingCoefficient();
+    };
+    return table;
+  }
+
+  /**
+   Build the table of the functions that obtain the value of a parameter, indexed by parameter address.
+
+   @returns the table
+   */
+  static constexpr std::array<Getter, parameterCount> makeGetters() noexcept {
+    std::array<Getter, parameterCount> table{};
+    table[size_t(Parameter::rate)] = [](const Engine& engine) noexcept { return engine.rate_.get(); };
+    table[size_t(Parameter::delay)] = [](const Engine& engine) noexcept { return engine.delay_.get(); };
+    table[size_t(Parameter::depth)] = [](const Engine& engine) noexcept { return engine.depth_.get(); };
+    table[size_t(Parameter::dry)] = [](const Engine& engine) noexcept { return engine.dryMix_.get(); };
+    table[size_t(Parameter::wet)] = [](const Engine& engine) noexcept { return engine.wetMix_.get(); };
+    table[size_t(Parameter::odd90)] = [](const Engine& engine) noexcept { return engine.odd90_ ? 1.0f : 0.0f; };
+    table[size_t(Parameter::quality)] = [](const Engine& engine) noexcept { return Value(engine.interpolator_); };
+    table[size_t(Parameter::voices)] = [](const Engine& engine) noexcept { return Value(engine.voiceCount_); };
+    table[size_t(Parameter::feedback)] = [](const Engine& engine) noexcept { return engine.feedback_.get(); };
+    table[size_t(Parameter::damping)] = [](const Engine& engine) noexcept { return engine.damping_; };
+    return table;
+  }
+
+  void setQuality(Value quality) noexcept {
+    auto index = std::clamp(int(std::round(quality)), int(Interpolator::none), int(Interpolator::allpass));
+    interpolator_ = Interpolator(index);
+  }
+
+  void setRate(Value rate, FrameCount rampingDuration) noexcept {
+    rate_.set(rate, rampingDuration);
+    for (size_t voice = 0; voice < maxVoices; ++voice) {
+      lfos_[voice].setFrequency(rate * voiceRateScale(voice), rampingDuration);
+    }
+  }
+
+  void setVoices(Value voices) noexcept {
+    auto count = size_t(std::clamp(int(std::round(voices)), 1, int(maxVoices)));
+    if (count == voiceCount_) return;
+
+    // Only the voices that start to sound are moved. Moving the phase of a voice that is already heard would jump its
+    // tap to another position in the delay line, which clicks.
+    auto first = voiceCount_;
+    voiceCount_ = count;
+    if (count > first) spreadVoicePhases(first);
+  }
+
+  /**
+   Obtain the LFO rate multiplier for a voice. Voice 0 runs at the `rate` setting and the others are detuned in
+   alternating directions by increasing amounts so that their phases drift against each other.
+
+   @param voice the voice to work with
+   @returns rate multiplier
+   */
+  static Value voiceRateScale(size_t voice) noexcept {
+    constexpr Value detune = 0.03;
+    auto step = Value((voice + 1) / 2);
+    return 1.0 + ((voice & 1) ? step : -step) * detune;
+  }
+
+  /**
+   Space the LFO phases of the active voices evenly around the circle, starting from the phase of voice 0.
+
+   @param first the first voice to move. The voices before it keep their phases.
+   */
+  void spreadVoicePhases(size_t first = 1) noexcept {
+    auto phase = lfos_[0].phase();
+    for (size_t voice = std::max<size_t>(first, 1); voice < maxVoices; ++voice) {
+      lfos_[voice].setPhase(T(phase + 2.0 * M_PI * voice / voiceCount_));
+    }
+  }
+
+  /// Advance the LFOs of the active voices without generating any values.
+  void skipVoices(std::array<LFO, maxVoices>& lfos, FrameCount frameCount) noexcept {
+    for (size_t voice = 0; voice < voiceCount_; ++voice) {
+      lfos[voice].skip(frameCount);
+    }
+  }
+
+  /// @returns the delays for a voice, starting from the current position in the render cycle
+  T* evenDelays(size_t voice) noexcept { return evenDelays_.data() + voice * delaysStride_ + cycleOffset_; }
+
+  /// @returns the odd-channel delays for a voice, starting from the current position in the render cycle
+  T* oddDelays(size_t voice) noexcept { return oddDelays_.data() + voice * delaysStride_ + cycleOffset_; }
+
+  /**
+   Apply a preset posted by `postPreset`, either at once or by starting a crossfade.
+
+   @param preset the values to apply
+   */
+  void applyPreset(const Preset& preset) noexcept {
+    if (preset.crossfadeFrames == 0) {
+      crossfade_.active = false;
+      ramps_.crossfade = 0;
+      setPresetValues(preset, true);
+      return;
+    }
+
+    crossfade_ = {preset, std::max<FrameCount>(preset.crossfadeFrames, 2), 0, false, true};
+    ramps_.crossfade = crossfade_.length / 2;
+
+    // Hold the wet mix at its current target while it fades out, and start the dry mix on its way.
+    wetMix_.set(wetMix_.get(), 0);
+    ramps_.wetMix = 0;
+    dryMix_.set(preset.dry, crossfade_.length);
+    ramps_.dryMix = crossfade_.length;
+  }
+
+  /**
+   Set all of the parameters of a preset without ramping.
+
+   @param preset the values to set
+   @param withDry true if the dry mix is also set
+   */
+  void setPresetValues(const Preset& preset, bool withDry) noexcept {
+    setParameterValue(Address(Parameter::rate), preset.rate, 0);
+    setParameterValue(Address(Parameter::delay), preset.delay, 0);
+    setParameterValue(Address(Parameter::depth), preset.depth, 0);
+    if (withDry) setParameterValue(Address(Parameter::dry), preset.dry, 0);
+    setParameterValue(Address(Parameter::wet), preset.wet, 0);
+    setParameterValue(Address(Parameter::odd90), preset.odd90, 0);
+    setParameterValue(Address(Parameter::quality), preset.quality, 0);
+    setParameterValue(Address(Parameter::voices), preset.voices, 0);
+    setParameterValue(Address(Parameter::feedback), preset.feedback, 0);
+    setParameterValue(Address(Parameter::damping), preset.damping, 0);
+
+    // The values reported by `getPostedParameterValue` since `postPreset` are now the engine's own, unless a later
+    // change is still waiting to be applied.
+    auto pending = postedChanges_.load(std::memory_order_acquire);
+    for (Address address = 0; address < parameterCount; ++address) {
+      if ((pending & (uint32_t(1) << address)) != 0) continue;
+      appliedSequences_[address].store(postedSequences_[address].load(std::memory_order_acquire),
+                                       std::memory_order_release);
+    }
+  }
+
+  /// @returns the values of a preset, in the order of their parameter addresses
+  static std::array<Value, parameterCount> presetValues(const Preset& preset) noexcept {
+    static_assert(parameterCount == 10, "a parameter is missing from the preset");
+    return {preset.rate, preset.delay, preset.depth, preset.dry, preset.wet, preset.odd90, preset.quality,
+            preset.voices, preset.feedback, preset.damping};
+  }
+
+  /// Move the crossfade on to its next phase once the current one is done.
+  void advanceCrossfade() noexcept {
+    if (!crossfade_.active || ramps_.crossfade > 0) return;
+    if (crossfade_.switched) {
+      crossfade_.active = false;
+      return;
+    }
+
+    crossfade_.switched = true;
+    setPresetValues(crossfade_.preset, false);
+    ramps_.crossfade = crossfade_.length - crossfade_.position;
+  }
+
+  /// Move between the bypass states at the start of a render cycle.
+  void updateBypassState() noexcept {
+    auto requested = bypassRequested_.load(std::memory_order_relaxed);
+    if (requested && bypassState_ == BypassState::active) {
+      bypassState_ = BypassState::draining;
+      // Drain for as long as the delay lines are in use, rather than converting the tail time back into frames.
+      drainRemaining_ = FrameCount(tailSpan(1.0E-3));
+    } else if (!requested && bypassState_ != BypassState::active) {
+      bypassState_ = BypassState::active;
+      clearDelayLines();
+    }
+
+    if (bypassState_ == BypassState::draining && drainRemaining_ == 0) bypassState_ = BypassState::bypassed;
+  }
+
+  /// Set the samples of all delay lines to zero.
+  void clearDelayLines() noexcept {
+    if (activeCompact_) {
+      for (size_t index = 0; index < compactDelayLines_.size(); ++index) compactDelayLines_[index].clear();
+    } else {
+      for (size_t index = 0; index < delayLines_.size(); ++index) delayLines_[index].clear();
+    }
+    std::fill(feedbackLoops_.begin(), feedbackLoops_.end(), FeedbackLoop{});
+  }
+
+  /**
+   Render one chunk of an offline render from the buffers in `offlineInputs_` to those in `offlineOutputs_`.
+
+   @param position the offset of the chunk from the start of the offline render
+   @param frameCount the number of frames in the chunk. Must not be more than `maxFramesToRender_`.
+   @param events the automation events of the offline render
+   @param eventCount the number of automation events
+   @param eventIndex the index of the next event to apply. Updated as events are applied.
+   */
+  void renderOfflineChunk(size_t position, FrameCount frameCount, const AutomationEvent* events,
+                          size_t eventCount, size_t& eventIndex) noexcept {
+    ChannelBuffers ins{offlineInputs_.data(), channelCount_};
+    ChannelBuffers outs{offlineOutputs_.data(), channelCount_};
+    DenormalGuard denormalGuard;
+    beginCycle(-1.0, 0);
+
+    auto end = position + frameCount;
+    while (position < end) {
+      for (; eventIndex < eventCount && events[eventIndex].sampleTime <= SampleTime(position); ++eventIndex) {
+        const auto& event = events[eventIndex];
+        sampleTime_ = event.sampleTime;
+        setParameterValue(event.address, event.value, event.rampDuration);
+      }
+
+      auto segmentEnd = end;
+      if (eventIndex < eventCount) segmentEnd = std::min<size_t>(end, size_t(events[eventIndex].sampleTime));
+      sampleTime_ = SampleTime(position);
+      render(ins, outs, FrameCount(segmentEnd - position));
+      position = segmentEnd;
+    }
+  }
+
+  /**
+   Render segments recorded by the bus that led the render cycle. The render calls of this bus do not have to split
+   the cycle the same way as those of the leading bus -- a segment that runs past the end of a call is finished in the
+   next one. All of the control data of a segment is held for the whole render cycle, so nothing is calculated again.
+
+   @param frameCount the number of frames to render
+   @param ins the input sample buffers
+   @param outs the output sample buffers
+   @returns the number of frames that could not be rendered from the recorded segments
+   */
+  FrameCount replaySegments(FrameCount frameCount, ChannelBuffers ins, ChannelBuffers outs) noexcept {
+    while (frameCount > 0 && replayIndex_ < segmentCount_) {
+      auto segment = segments_[replayIndex_];
+      segment.frameCount -= replayOffset_;
+      if (segment.frameCount > frameCount) {
+        segment.frameCount = frameCount;
+        replayOffset_ += frameCount;
+      } else {
+        ++replayIndex_;
+        replayOffset_ = 0;
+      }
+      renderSegment(segment, ins, outs);
+      frameCount -= segment.frameCount;
+    }
+    return frameCount;
+  }
+
+  /**
+   Render frames of a bus that replays the render cycle but that the leading bus did not render, so there is no
+   control data for them. They are rendered with the settings the leading bus ended the cycle with, using copies of
+   the LFOs and ramping values so that the state shared by all busses does not move on a second time.
+
+   @param frameCount the number of frames to render
+   @param ins the input sample buffers
+   @param outs the output sample buffers
+   */
+  void renderUnrecorded(FrameCount frameCount, ChannelBuffers ins, ChannelBuffers outs) noexcept {
+    auto lfos = lfos_;
+    auto next = [](auto value) noexcept { return value.frameValue(); };
+    renderSegment(makeSteadySegment(frameCount, lfos, tapFor(next(delay_)), next(depth_), next(wetMix_), next(dryMix_),
+                                    next(feedback_)), ins, outs);
+  }
+
+  /**
+   Convert a delay setting into a tap position. The delay parameter is in milliseconds, and so are the sizes of the
+   delay lines and the tail time, but the taps are in samples.
+
+   @param delay the delay in milliseconds
+   @returns the distance of the tap from the newest sample in the delay lines
+   */
+  T tapFor(T delay) const noexcept { return delay * T(samplesPerMillisecond_); }
+
+  /**
+   Calculate the displacement of the delay tap for the given tap and depth settings.
+
+   @param tap the nominal position of the tap into the delay line
+   @param displacementFraction the fraction of the overall displacement available to move the tap
+   @returns the distance from the nominal tap to a non-zero min value
+   */
+  static T displacementFor(T tap, T displacementFraction) noexcept {
+    assert(displacementFraction >= 0.0 && displacementFraction <= 1.0);
+    constexpr T minTap = 1.0E-3;
+    return std::max<T>(tap - minTap, 0.0) * displacementFraction;
+  }
+
+  /**
+   Create a segment description using the current parameter settings.
+
+   @param frameCount the number of frames in the segment
+   @param mode how the segment is to be rendered
+   @param ramping true if the per-frame mix values are to be used
+   @param tap the delay of a static delay
+   @param wetMix the wet mix value to use when not ramping
+   @param dryMix the dry mix value to use when not ramping
+   @param feedback the feedback value to use when not ramping
+   @param recirculating true if the feedback path is in use
+   */
+  Segment makeSegment(FrameCount frameCount, RenderMode mode, bool ramping, T tap, T wetMix, T dryMix, T feedback,
+                      bool recirculating) const noexcept {
+    auto draining = bypassState_ == BypassState::draining;
+    return {frameCount, mode, ramping, interpolator_, odd90_, voiceCount_, tap, wetMix, draining ? T(1.0) : dryMix,
+            feedback, recirculating, draining};
+  }
+
+  /**
+   Record a segment for other busses to replay (if leading the render cycle), then render it.
+
+   @param segment the segment to render
+   @param ins the input sample buffers
+   @param outs the output sample buffers
+   */
+  void recordAndRenderSegment(const Segment& segment, ChannelBuffers ins, ChannelBuffers outs) noexcept {
+    if (!replaying_ && segmentCount_ < segments_.size()) {
+      segments_[segmentCount_++] = segment;
+    }
+    renderSegment(segment, ins, outs);
+  }
+
+  /**
+   Obtain the values of a parameter for each frame of a ramp segment. A parameter that is not ramping is only read
+   once.
+
+   @param parameter the parameter to read
+   @param remaining the number of frames left in the ramp of the parameter
+   @param values the destination for the values
+   @param frameCount the number of frames in the segment. Must not be more than `remaining` if that is not zero.
+   */
+  template <typename Parameter>
+  static void rampValues(Parameter& parameter, FrameCount remaining, T* values,
+                         FrameCount frameCount) noexcept {
+    assert(remaining == 0 || remaining >= frameCount);
+    if (remaining == 0) {
+      std::fill_n(values, frameCount, parameter.frameValue());
+    } else {
+      for (FrameCount frame = 0; frame < frameCount; ++frame) {
+        values[frame] = parameter.frameValue();
+      }
+    }
+  }
+
+  void renderRampingFrames(FrameCount frameCount, ChannelBuffers ins, ChannelBuffers outs) noexcept {
+    assert(cycleOffset_ + frameCount <= rampWetMix_.size());
+
+    // Fetch the values for each frame, stepping only the parameters that are ramping.
+    auto wetMixes = rampWetMix_.data() + cycleOffset_;
+    auto dryMixes = rampDryMix_.data() + cycleOffset_;
+    rampValues(delay_, ramps_.delay, rampTap_.data(), frameCount);
+    for (FrameCount frame = 0; frame < frameCount; ++frame) rampTap_[frame] = tapFor(rampTap_[frame]);
+    rampValues(depth_, ramps_.depth, rampDisplacement_.data(), frameCount);
+    rampValues(wetMix_, ramps_.wetMix, wetMixes, frameCount);
+    rampValues(dryMix_, ramps_.dryMix, dryMixes, frameCount);
+    auto feedbacks = rampFeedback_.data() + cycleOffset_;
+    rampValues(feedback_, ramps_.feedback, feedbacks, frameCount);
+    auto recirculating = ramps_.feedback > 0 || feedbacks[0] != 0.0;
+    if (bypassState_ == BypassState::draining) std::fill_n(dryMixes, frameCount, T(1.0));
+    if (ramps_.crossfade > 0) {
+      // Equal-power fade of the wet signal, out to the midpoint of the crossfade and then back in.
+      constexpr double pi = 3.14159265358979323846;
+      auto scale = pi / double(crossfade_.length);
+      for (FrameCount frame = 0; frame < frameCount; ++frame) {
+        wetMixes[frame] *= T(std::abs(std::cos((crossfade_.position + frame) * scale)));
+      }
+      crossfade_.position += frameCount;
+    }
+
+    // With only the mix ramping, the delays are calculated the same way as for a steady block.
+    auto mode = RenderMode::chorus;
+    auto tap = rampTap_[0];
+    if (ramps_.modulation()) {
+      for (FrameCount frame = 0; frame < frameCount; ++frame) {
+        rampDisplacement_[frame] = displacementFor(rampTap_[frame], rampDisplacement_[frame]);
+      }
+      for (size_t voice = 0; voice < voiceCount_; ++voice) {
+        auto even = evenDelays(voice);
+        auto odd = oddDelays(voice);
+        lfos_[voice].fill(even, odd, frameCount);
+        for (FrameCount frame = 0; frame < frameCount; ++frame) {
+          even[frame] = even[frame] * rampDisplacement_[frame] + rampTap_[frame];
+          odd[frame] = odd[frame] * rampDisplacement_[frame] + rampTap_[frame];
+        }
+      }
+    } else {
+      auto displacement = displacementFor(tap, rampDisplacement_[0]);
+      if (displacement == 0.0) {
+        mode = RenderMode::staticDelay;
+        skipVoices(lfos_, frameCount);
+      } else {
+        fillVoiceDelays(lfos_, frameCount, tap, displacement);
+      }
+    }
+
+    // The wet mix and the feedback are split evenly among the voices.
+    if (mode == RenderMode::chorus && voiceCount_ > 1) {
+      auto voiceGain = T(1.0) / T(voiceCount_);
+      for (FrameCount frame = 0; frame < frameCount; ++frame) {
+        wetMixes[frame] *= voiceGain;
+      }
+      if (recirculating) {
+        for (FrameCount frame = 0; frame < frameCount; ++frame) {
+          feedbacks[frame] *= voiceGain;
+        }
+      }
+    }
+
+    recordAndRenderSegment(makeSegment(frameCount, mode, true, tap, 0.0, 0.0, 0.0, recirculating), ins, outs);
+  }
+
+  /**
+   Generate the delay offsets of each voice for a block with a steady tap and displacement.
+
+   @param lfos the LFOs to generate the delays with
+   @param frameCount the number of frames in the block
+   @param tap the nominal position of the tap into the delay lines
+   @param displacement the distance the LFOs move the tap
+   */
+  void fillVoiceDelays(std::array<LFO, maxVoices>& lfos, FrameCount frameCount, T tap, T displacement) noexcept {
+    for (size_t voice = 0; voice < voiceCount_; ++voice) {
+      lfos[voice].fill(evenDelays(voice), oddDelays(voice), frameCount, displacement, tap);
+    }
+  }
+
+  /**
+   Determine how a block with steady parameter values must be rendered.
+
+   @param wetMix the wet mix value for the block
+   @param feedback the feedback value for the block
+   @param displacement the LFO displacement for the block
+   @returns the cheapest mode that produces the same output
+   */
+  static RenderMode renderModeFor(T wetMix, T feedback, T displacement) noexcept {
+    if (wetMix == 0.0 && feedback == 0.0) return RenderMode::passthrough;
+    if (displacement == 0.0) return RenderMode::staticDelay;
+    return RenderMode::chorus;
+  }
+
+  void renderFrames(FrameCount frameCount, ChannelBuffers ins, ChannelBuffers outs) noexcept {
+    auto segment = makeSteadySegment(frameCount, lfos_, tapFor(delay_.frameValue()), depth_.frameValue(),
+                                     wetMix_.frameValue(), dryMix_.frameValue(), feedback_.frameValue());
+    recordAndRenderSegment(segment, ins, outs);
+  }
+
+  /**
+   Create the segment for a block with steady parameter values, and generate its delays.
+
+   @param frameCount the number of frames in the block
+   @param lfos the LFOs to generate the delays with
+   @param tap the nominal position of the tap into the delay lines
+   @param depth the fraction of the tap that the LFOs move it by
+   @param wetMix the wet mix value for the block
+   @param dryMix the dry mix value for the block
+   @param feedback the feedback value for the block
+   @returns the segment
+   */
+  Segment makeSteadySegment(FrameCount frameCount, std::array<LFO, maxVoices>& lfos, T tap, T depth, T wetMix,
+                            T dryMix, T feedback) noexcept {
+    assert(cycleOffset_ + frameCount <= delaysStride_);
+    assert(wetMix >= 0.0 && wetMix <= 1.0);
+    assert(dryMix >= 0.0 && dryMix <= 1.0);
+
+    // Displacement is the distance from the nominal tap to a non-zero min value.
+    auto displacement = displacementFor(tap, depth);
+
+    // In every mode the delay lines take in the input samples and the LFO advances so that a change to another mode
+    // picks up where this one left off.
+    auto mode = renderModeFor(wetMix, feedback, displacement);
+    switch (mode) {
+      case RenderMode::passthrough:
+      case RenderMode::staticDelay:
+        skipVoices(lfos, frameCount);
+        break;
+
+      case RenderMode::chorus:
+        // Generate the delay offsets of each voice for the block once. Every channel then uses them to read from its
+        // own delay line.
+        fillVoiceDelays(lfos, frameCount, tap, displacement);
+        wetMix /= T(voiceCount_);
+        feedback /= T(voiceCount_);
+        break;
+    }
+
+    return makeSegment(frameCount, mode, false, tap, wetMix, dryMix, feedback, feedback != 0.0);
+  }
+
+  /**
+   Render the frames of a segment for the current bus using the control data at `cycleOffset_`.
+
+   @param segment the description of the segment to render
+   @param ins the input sample buffers
+   @param outs the output sample buffers
+   */
+  void renderSegment(const Segment& segment, ChannelBuffers ins, ChannelBuffers outs) noexcept {
+    if (activeCompact_) {
+      renderSegment<CompactSample>(segment, ins, outs);
+    } else {
+      renderSegment<T>(segment, ins, outs);
+    }
+    cycleOffset_ += segment.frameCount;
+  }
+
+  /**
+   Render the frames of a segment with the delay lines that hold samples of type `S`.
+
+   @param S the sample type of the delay lines to use
+   @param segment the description of the segment to render
+   @param ins the input sample buffers
+   @param outs the output sample buffers
+   */
+  template <typename S>
+  void renderSegment(const Segment& segment, ChannelBuffers ins, ChannelBuffers outs) noexcept {
+    if (segment.draining && segment.mode == RenderMode::passthrough) {
+      // Without a wet signal there is no tail to play out.
+      renderBypassed(segment.frameCount, ins, outs);
+    } else if (interleaved_) {
+      auto input = interleavedInput_ + cycleOffset_ * channelCount_;
+      auto output = interleavedOutput_ + cycleOffset_ * channelCount_;
+      if (segment.mode == RenderMode::passthrough) {
+        renderPassthroughInterleaved<S>(segment.frameCount, segment.dryMix, input, output);
+      } else {
+        switch (segment.interpolator) {
+          case Interpolator::none: renderInterleaved<S, Interpolator::none>(segment, input, output); break;
+          case Interpolator::linear: renderInterleaved<S, Interpolator::linear>(segment, input, output); break;
+          case Interpolator::cubic4thOrder:
+            renderInterleaved<S, Interpolator::cubic4thOrder>(segment, input, output);
+            break;
+          case Interpolator::allpass: renderInterleaved<S, Interpolator::allpass>(segment, input, output); break;
+        }
+      }
+    } else if (segment.mode == RenderMode::passthrough) {
+      renderPassthrough<S>(segment.frameCount, segment.dryMix, ins, outs);
+    } else {
+      switch (segment.interpolator) {
+        case Interpolator::none: renderChannels<S, Interpolator::none>(segment, ins, outs); break;
+        case Interpolator::linear: renderChannels<S, Interpolator::linear>(segment, ins, outs); break;
+        case Interpolator::cubic4thOrder: renderChannels<S, Interpolator::cubic4thOrder>(segment, ins, outs); break;
+        case Interpolator::allpass: renderChannels<S, Interpolator::allpass>(segment, ins, outs); break;
+      }
+    }
+  }
+
+  /// @returns the number of samples held by each of the delay lines in use
+  size_t delayLineSpan() const noexcept {
+    if (activeCompact_) return compactDelayLines_.empty() ? 0 : compactDelayLines_[0].size();
+    return delayLines_.empty() ? 0 : delayLines_[0].size();
+  }
+
+  /**
+   Obtain the number of silent input frames it takes for what is in the delay lines to fall below a level. Each trip
+   around the feedback loop is taken to be the whole span of the delay lines, so this never falls short of the delay
+   that the taps actually use.
+
+   @param level the level, relative to full scale, below which the delay lines count as silent
+   @returns the number of frames
+   */
+  size_t tailSpan(double level) const noexcept {
+    auto span = delayLineSpan() + lanes;
+    return span + size_t(feedbackTrips(level) * span);
+  }
+
+  /// @returns the number of silent frames after which the delay lines can only hold silence
+  size_t silenceSpan() const noexcept { return tailSpan(1.0E-6); }
+
+  /**
+   Obtain the number of trips around the feedback loop it takes for a signal to fall to a given level. Damping only
+   makes the signal fall faster, so it is left out.
+
+   @param level the level to fall to
+   @returns number of trips, which is 0 without feedback
+   */
+  double feedbackTrips(double level) const noexcept {
+    auto gain = std::min<double>(std::abs(feedback_.get()), maxFeedback) / 100.0;
+    return gain > 0.0 ? std::ceil(std::log(level) / std::log(gain)) : 0.0;
+  }
+
+  /**
+   Calculate the coefficient of the damping filter from the damping setting. The cutoff frequency of the filter falls
+   exponentially from nearly 20 kHz at 1% to 500 Hz at 100%, and at 0% there is no filtering at all.
+   */
+  void updateDampingCoefficient() noexcept {
+    if (damping_ <= 0.0) {
+      dampingCoefficient_ = T(1.0);
+      return;
+    }
+    constexpr double pi = 3.14159265358979323846;
+    auto cutoff = 20000.0 * std::pow(500.0 / 20000.0, double(damping_) / 100.0);
+    auto coefficient = 1.0 - std::exp(-2.0 * pi * cutoff / (samplesPerMillisecond_ * 1000.0));
+    dampingCoefficient_ = T(std::clamp(coefficient, 0.0, 1.0));
+  }
+
+  /**
+   Determine if a block of samples is all zeros. This ORs together the magnitude bits of the samples, which the
+   compiler turns into a few vector instructions per set of lanes.
+
+   @param samples the samples to check
+   @param count the number of samples to check
+   @returns true if all of the samples are +0.0 or -0.0
+   */
+  static bool isSilent(const Value* samples, size_t count) noexcept {
+    static_assert(sizeof(Value) == sizeof(uint32_t));
+    uint32_t bits = 0;
+    for (size_t index = 0; index < count; ++index) {
+      uint32_t value;
+      std::memcpy(&value, samples + index, sizeof(value));
+      bits |= value;
+    }
+    return (bits & 0x7FFFFFFF) == 0;
+  }
+
+  /// @returns true if all of the input samples of the next `frameCount` frames are zero
+  bool isInputSilent(FrameCount frameCount, ChannelBuffers ins) const noexcept {
+    if (interleaved_) return isSilent(interleavedInput_ + cycleOffset_ * channelCount_, frameCount * channelCount_);
+    for (size_t channel = 0; channel < ins.size(); ++channel) {
+      if (!isSilent(ins[channel], frameCount)) return false;
+    }
+    return true;
+  }
+
+  /**
+   Skip the rendering of frames that can only produce silence. Once the input has been all zeros for longer than the
+   span of the delay lines -- and the feedback has had time to die away -- every sample the delay lines can read is
+   zero too, so the output is zero no matter what
+   the settings are. The delay lines are then left alone and only the LFOs advance, so that the modulation picks up
+   where it would have been when the input returns.
+
+   This only applies with one bus since the other busses replay the segments that the first bus renders.
+
+   @param frameCount the number of frames to render
+   @param ins the input sample buffers
+   @param outs the output sample buffers
+   @returns true if the frames were skipped and the output set to zero
+   */
+  bool renderSilence(FrameCount frameCount, ChannelBuffers ins, ChannelBuffers outs) noexcept {
+    if (busCount_ > 1 || bypassState_ != BypassState::active) return false;
+    if (!isInputSilent(frameCount, ins)) {
+      silentFrames_ = 0;
+      silenceCleared_ = false;
+      return false;
+    }
+
+    if (!isSilenceIdle()) {
+      silentFrames_ += frameCount;
+      return false;
+    }
+
+    // With feedback the delay lines only ever decay towards zero. By now they are at least 120 dB down, so make them
+    // silent.
+    if (!silenceCleared_) {
+      clearDelayLines();
+      silenceCleared_ = true;
+    }
+
+    // The output is all zeros, the same as the input.
+    renderBypassed(frameCount, ins, outs);
+    skipVoices(lfos_, frameCount);
+    skippedFrames_ += frameCount;
+    return true;
+  }
+
+  /**
+   Copy the input samples to the output without touching the delay lines.
+
+   @param frameCount the number of frames to copy
+   @param ins the input sample buffers
+   @param outs the output sample buffers
+   */
+  void renderBypassed(FrameCount frameCount, ChannelBuffers ins, ChannelBuffers outs) noexcept {
+    if (interleaved_) {
+      auto offset = cycleOffset_ * channelCount_;
+      auto input = interleavedInput_ + offset;
+      auto output = interleavedOutput_ + offset;
+      if (output != input) std::copy_n(input, frameCount * channelCount_, output);
+      cycleOffset_ += frameCount;
+      return;
+    }
+
+    for (size_t channel = 0; channel < ins.size(); ++channel) {
+      auto& input = ins[channel];
+      auto& output = outs[channel];
+      if (output != input) std::copy_n(input, frameCount, output);
+      input += frameCount;
+      output += frameCount;
+    }
+    cycleOffset_ += frameCount;
+  }
+
+  /**
+   Render a block that has no wet signal. The delay lines are only written to.
+
+   @param frameCount the number of frames to render
+   @param dryMix the dry mix value to apply to the input samples
+   @param ins the input sample buffers
+   @param outs the output sample buffers
+   */
+  template <typename S>
+  void renderPassthrough(FrameCount frameCount, T dryMix, ChannelBuffers ins, ChannelBuffers outs) noexcept {
+    for (size_t channel = 0; channel < ins.size(); ++channel) {
+      auto& input = ins[channel];
+      auto& output = outs[channel];
+      auto& delayLine = delayLines<S>()[delayLineBase_ + channel];
+      if constexpr (std::is_same_v<T, Value>) {
+        delayLine.write(input, frameCount);
+      } else {
+        for (FrameCount frame = 0; frame < frameCount; ++frame) {
+          delayLine.write(T(input[frame]));
+        }
+      }
+
+      if (dryMix == 1.0) {
+        if (output != input) std::copy_n(input, frameCount, output);
+      } else {
+        for (FrameCount frame = 0; frame < frameCount; ++frame) {
+          output[frame] = Value(dryMix * input[frame]);
+        }
+      }
+
+      input += frameCount;
+      output += frameCount;
+    }
+  }
+
+  /**
+   Render a block that has no wet signal from interleaved samples. The delay lines are only written to.
+
+   @param frameCount the number of frames to render
+   @param dryMix the dry mix value to apply to the input samples
+   @param input the interleaved input samples
+   @param output the interleaved output samples
+   */
+  template <typename S>
+  void renderPassthroughInterleaved(FrameCount frameCount, T dryMix, const Value* input, Value* output) noexcept {
+    auto stride = channelCount_;
+    for (size_t channel = 0; channel < stride; ++channel) {
+      auto& delayLine = delayLines<S>()[delayLineBase_ + channel];
+      for (FrameCount frame = 0; frame < frameCount; ++frame) {
+        delayLine.write(input[frame * stride + channel]);
+      }
+    }
+
+    auto sampleCount = frameCount * stride;
+    if (dryMix == 1.0) {
+      if (output != input) std::copy_n(input, sampleCount, output);
+    } else {
+      for (size_t index = 0; index < sampleCount; ++index) {
+        output[index] = Value(dryMix * input[index]);
+      }
+    }
+  }
+
+  /**
+   Render the frames of a segment from interleaved samples using the delay offsets in `evenDelays_` and `oddDelays_`.
+
+   @param segment the description of the segment to render
+   @param input the interleaved input samples
+   @param output the interleaved output samples
+   */
+  template <typename S, Interpolator I>
+  void renderInterleaved(const Segment& segment, const Value* input, Value* output) noexcept {
+    auto modulated = segment.mode == RenderMode::chorus;
+    auto odd90 = modulated && segment.odd90 && channelCount_ > 1;
+    auto voiceCount = modulated ? segment.voiceCount : 1;
+    prepareTaps<I>(segment, modulated, voiceCount, odd90);
+    switch (channelCount_) {
+      case 1:
+        renderInterleavedBlock<S, I, 1, false>(segment, modulated, voiceCount, input, output);
+        break;
+      case 2:
+        if (odd90) {
+          renderInterleavedBlock<S, I, 2, true>(segment, modulated, voiceCount, input, output);
+        } else {
+          renderInterleavedBlock<S, I, 2, false>(segment, modulated, voiceCount, input, output);
+        }
+        break;
+      default:
+        if (odd90) {
+          renderInterleavedBlock<S, I, 0, true>(segment, modulated, voiceCount, input, output);
+        } else {
+          renderInterleavedBlock<S, I, 0, false>(segment, modulated, voiceCount, input, output);
+        }
+        break;
+    }
+  }
+
+  /**
+   Render the frames of a segment from interleaved samples for a specific channel count. Each set of lanes is done for
+   all channels before moving on, so for stereo the left and right samples of a frame are read and written together.
+   Only a set of lanes of one channel is ever copied out of the interleaved buffer.
+
+   @param Channels the number of channels to render, or 0 to use `channelCount_`
+   @param Odd90 true if odd channels read with the delays in `oddTaps_`
+   @param segment the description of the segment to render
+   @param modulated true if each frame of each voice has its own delay offset
+   @param voiceCount the number of voices to read and sum for each frame
+   @param input the interleaved input samples
+   @param output the interleaved output samples
+   */
+  template <typename S, Interpolator I, size_t Channels, bool Odd90>
+  void renderInterleavedBlock(const Segment& segment, bool modulated, size_t voiceCount, const Value* input,
+                              Value* output) noexcept {
+    assert(Channels == 0 || Channels == channelCount_);
+    size_t stride = Channels > 0 ? Channels : channelCount_;
+    size_t tapsStride = modulated ? voiceCount : 0;
+    auto frameCount = segment.frameCount;
+    for (FrameCount offset = 0; offset < frameCount; offset += lanes) {
+      auto count = std::min<FrameCount>(lanes, frameCount - offset);
+      auto frameInput = input + offset * stride;
+      auto frameOutput = output + offset * stride;
+      for (size_t channel = 0; channel < stride; ++channel) {
+        auto& taps = (Odd90 && (channel & 1)) ? oddTaps_ : evenTaps_;
+        auto voiceTaps = taps.data() + offset / lanes * tapsStride;
+        T samples[lanes];
+        T delayed[lanes];
+        for (FrameCount frame = 0; frame < count; ++frame) {
+          samples[frame] = frameInput[frame * stride + channel];
+        }
+        auto& delayLine = delayLines<S>()[delayLineBase_ + channel];
+        auto& loop = feedbackLoops_[delayLineBase_ + channel];
+        processBlock<I>(delayLine, loop, segment, offset, samples, voiceTaps, voiceCount, count, delayed);
+        if (segment.ramping) {
+          auto wetMixes = rampWetMix_.data() + cycleOffset_ + offset;
+          auto dryMixes = rampDryMix_.data() + cycleOffset_ + offset;
+          for (FrameCount frame = 0; frame < count; ++frame) {
+            frameOutput[frame * stride + channel] = Value(wetMixes[frame] * delayed[frame] +
+                                                          dryMixes[frame] * samples[frame]);
+          }
+        } else {
+          for (FrameCount frame = 0; frame < count; ++frame) {
+            frameOutput[frame * stride + channel] = Value(segment.wetMix * delayed[frame] +
+                                                          segment.dryMix * samples[frame]);
+          }
+        }
+      }
+    }
+  }
+
+  /**
+   Render the frames of a segment one channel at a time using the delay offsets in `evenDelays_` and `oddDelays_`.
+   For a static delay there is one voice and all frames use the delay of the segment.
+
+   @param segment the description of the segment to render
+   @param ins the input sample buffers
+   @param outs the output sample buffers
+   */
+  template <typename S, Interpolator I>
+  void renderChannels(const Segment& segment, ChannelBuffers ins, ChannelBuffers outs) noexcept {
+    // A static delay is the same for every frame, so one set of interpolation settings serves the whole block.
+    auto modulated = segment.mode == RenderMode::chorus;
+    auto odd90 = modulated && segment.odd90 && ins.size() > 1;
+    auto voiceCount = modulated ? segment.voiceCount : 1;
+    prepareTaps<I>(segment, modulated, voiceCount, odd90);
+
+    // Pick the loop that matches the channel layout once per block. Mono and stereo have fixed channel counts so that
+    // their channel loops unroll completely.
+    switch (ins.size()) {
+      case 1:
+        renderBlock<S, I, 1, false>(segment, modulated, voiceCount, ins, outs);
+        break;
+      case 2:
+        if (odd90) {
+          renderBlock<S, I, 2, true>(segment, modulated, voiceCount, ins, outs);
+        } else {
+          renderBlock<S, I, 2, false>(segment, modulated, voiceCount, ins, outs);
+        }
+        break;
+      default:
+        if (workers_.size() > 0 && ins.size() >= parallelChannelCount_) {
+          if (odd90) {
+            renderParallel<S, I, true>(segment, modulated, voiceCount, ins, outs);
+          } else {
+            renderParallel<S, I, false>(segment, modulated, voiceCount, ins, outs);
+          }
+        } else if (odd90) {
+          renderBlock<S, I, 0, true>(segment, modulated, voiceCount, ins, outs, 0, ins.size());
+        } else {
+          renderBlock<S, I, 0, false>(segment, modulated, voiceCount, ins, outs, 0, ins.size());
+        }
+        break;
+    }
+  }
+
+  /// The values shared by the tasks of a parallel render.
+  struct ParallelRender {
+    Engine* engine;
+    const Segment* segment;
+    bool modulated;
+    size_t voiceCount;
+    ChannelBuffers* ins;
+    ChannelBuffers* outs;
+    size_t channelsPerTask;
+  };
+
+  /**
+   Render the channels of a segment in groups, one group per task, with the render thread and the worker threads
+   taking tasks until all are done. Each channel has its own delay line and input and output buffers, and the
+   interpolation settings were calculated beforehand, so the groups share nothing that is written to.
+   */
+  template <typename S, Interpolator I, bool Odd90>
+  void renderParallel(const Segment& segment, bool modulated, size_t voiceCount, ChannelBuffers ins,
+                      ChannelBuffers outs) noexcept {
+    auto channelCount = ins.size();
+    auto taskCount = std::min(workers_.size() + 1, channelCount);
+    ParallelRender job{this, &segment, modulated, voiceCount, &ins, &outs, (channelCount + taskCount - 1) / taskCount};
+    auto tasks = (channelCount + job.channelsPerTask - 1) / job.channelsPerTask;
+    workers_.run(tasks, &renderParallelTask<S, I, Odd90>, &job);
+  }
+
+  template <typename S, Interpolator I, bool Odd90>
+  static void renderParallelTask(void* context, size_t index) noexcept {
+    auto& job = *static_cast<ParallelRender*>(context);
+    auto first = index * job.channelsPerTask;
+    auto end = std::min(first + job.channelsPerTask, job.ins->size());
+    job.engine->template renderBlock<S, I, 0, Odd90>(*job.segment, job.modulated, job.voiceCount, *job.ins,
+                                                     *job.outs, first, end);
+  }
+
+  /**
+   Render the frames of a segment for a specific channel layout.
+
+   @param Channels the number of channels to render, or 0 to use the number of input buffers
+   @param Odd90 true if odd channels read with the delays in `oddTaps_`
+   @param segment the description of the segment to render
+   @param modulated true if each frame of each voice has its own delay offset
+   @param voiceCount the number of voices to read and sum for each frame
+   @param ins the input sample buffers
+   @param outs the output sample buffers
+   @param firstChannel the first channel to render when `Channels` is 0
+   @param endChannel one past the last channel to render when `Channels` is 0
+   */
+  template <typename S, Interpolator I, size_t Channels, bool Odd90>
+  void renderBlock(const Segment& segment, bool modulated, size_t voiceCount, ChannelBuffers ins,
+                   ChannelBuffers outs, size_t firstChannel = 0, size_t endChannel = Channels) noexcept {
+    assert(Channels == 0 || Channels == ins.size());
+    if constexpr (Channels > 0) {
+      firstChannel = 0;
+      endChannel = Channels;
+    }
+    size_t tapsStride = modulated ? voiceCount : 0;
+    auto frameCount = segment.frameCount;
+    auto wetMix = segment.wetMix;
+    auto dryMix = segment.dryMix;
+
+    // Process one channel at a time so that only one delay line is being touched.
+    for (size_t channel = firstChannel; channel < endChannel; ++channel) {
+      auto& input = ins[channel];
+      auto& output = outs[channel];
+      auto& taps = (Odd90 && (channel & 1)) ? oddTaps_ : evenTaps_;
+      auto& delayLine = delayLines<S>()[delayLineBase_ + channel];
+      auto& loop = feedbackLoops_[delayLineBase_ + channel];
+      T delayed[lanes];
+      for (FrameCount offset = 0; offset < frameCount; offset += lanes) {
+        auto count = std::min<FrameCount>(lanes, frameCount - offset);
+        auto voiceTaps = taps.data() + offset / lanes * tapsStride;
+        processBlock<I>(delayLine, loop, segment, offset, input + offset, voiceTaps, voiceCount, count, delayed);
+        if (segment.ramping) {
+          auto wetMixes = rampWetMix_.data() + cycleOffset_ + offset;
+          auto dryMixes = rampDryMix_.data() + cycleOffset_ + offset;
+          for (FrameCount frame = 0; frame < count; ++frame) {
+            output[offset + frame] = Value(wetMixes[frame] * delayed[frame] + dryMixes[frame] * input[offset + frame]);
+          }
+        } else {
+          for (FrameCount frame = 0; frame < count; ++frame) {
+            output[offset + frame] = Value(wetMix * delayed[frame] + dryMix * input[offset + frame]);
+          }
+        }
+      }
+
+      input += frameCount;
+      output += frameCount;
+    }
+  }
+
+  /**
+   Calculate the interpolation settings for all of the frames of a segment from the values in `evenDelays_` and
+   `oddDelays_`. These are shared by all channels that read with the same delays. The settings for all of the voices
+   of one set of lanes are next to each other so that a delay line can read them in one go.
+
+   @param segment the description of the segment to render
+   @param modulated true if each frame has its own delay. Otherwise one set of settings for the delay of the segment
+   serves every set of lanes.
+   @param voiceCount the number of voices to calculate
+   @param withOdd true if the settings for the odd channels are also needed
+   */
+  template <Interpolator I>
+  void prepareTaps(const Segment& segment, bool modulated, size_t voiceCount, bool withOdd) noexcept {
+    if (!modulated) {
+      T delays[lanes];
+      std::fill_n(delays, lanes, segment.tap);
+      evenTaps_[0].template compute<I>(delays, lanes, maxTapDelay_);
+      return;
+    }
+    prepareTaps<I>(segment.frameCount, voiceCount, withOdd);
+  }
+
+  /// Calculate the interpolation settings for the first `frameCount` frames at the current position in the cycle.
+  template <Interpolator I>
+  void prepareTaps(FrameCount frameCount, size_t voiceCount, bool withOdd) noexcept {
+    auto maxDelay = maxTapDelay_;
+    for (FrameCount offset = 0; offset < frameCount; offset += lanes) {
+      auto count = std::min<FrameCount>(lanes, frameCount - offset);
+      auto index = offset / lanes * voiceCount;
+      for (size_t voice = 0; voice < voiceCount; ++voice) {
+        evenTaps_[index + voice].template compute<I>(evenDelays(voice) + offset, count, maxDelay);
+        if (withOdd) {
+          oddTaps_[index + voice].template compute<I>(oddDelays(voice) + offset, count, maxDelay);
+        }
+      }
+    }
+  }
+
+  // Percentages are rendered as fractions
+  RampingValue<Value> rate_;
+  RampingValue<Value> depth_{0.01};
+  RampingValue<Value> delay_;
+  RampingValue<Value> dryMix_{0.01};
+  RampingValue<Value> wetMix_{0.01};
+  RampingValue<Value> feedback_{0.01};
+  Value damping_{0.0};
+  T dampingCoefficient_{1.0};
+  bool odd90_{false};
+  Interpolator interpolator_{Interpolator::cubic4thOrder};
+
+  double samplesPerMillisecond_{44.1};
+
+  DelayLinePool<T> delayLines_;
+  DelayLinePool<T, CompactSample> compactDelayLines_;
+  // The storage chosen by `setCompactDelayLines`, and the one `configure` bound the delay lines to.
+  std::atomic<bool> compactStorage_{false};
+  bool activeCompact_{false};
+  bool denormalBias_{false};
+  bool delayLinesGrew_{false};
+  bool spanShrinkPending_{false};
+  T maxTapDelay_{1.0};
+  Buffer<T, storageFrames> rampTap_;
+  Buffer<T, storageFrames> rampDisplacement_;
+  Buffer<T, storageFrames> rampWetMix_;
+  Buffer<T, storageFrames> rampDryMix_;
+  Buffer<T, storageFrames> rampFeedback_;
+  Buffer<T, maxVoices * (storageFrames + lanes)> evenDelays_;
+  Buffer<T, maxVoices * (storageFrames + lanes)> oddDelays_;
+  size_t delaysStride_{lanes};
+  Buffer<Taps, maxVoices * ((storageFrames + lanes - 1) / lanes)> evenTaps_;
+  Buffer<Taps, maxVoices * ((storageFrames + lanes - 1) / lanes)> oddTaps_;
+  std::array<LFO, maxVoices> lfos_;
+  size_t voiceCount_{1};
+  RampCounts ramps_;
+  std::vector<FeedbackLoop> feedbackLoops_;
+  TripleBuffer<Preset> presets_;
+  Crossfade crossfade_{};
+
+  size_t busCount_{1};
+  size_t channelCount_{0};
+  FrameCount maxFramesToRender_{0};
+  size_t delayLineBase_{0};
+  double cycleSampleTime_{-1.0};
+  size_t cycleLeader_{0};
+  FrameCount cycleOffset_{0};
+  bool replaying_{false};
+  Buffer<Segment, storageFrames> segments_;
+  size_t segmentCount_{0};
+  size_t replayIndex_{0};
+  FrameCount replayOffset_{0};
+
+  std::vector<Value*> offlineInputs_;
+  std::vector<Value*> offlineOutputs_;
+  bool interleaved_{false};
+  const Value* interleavedInput_{nullptr};
+  Value* interleavedOutput_{nullptr};
+
+  std::atomic<bool> bypassRequested_{false};
+  BypassState bypassState_{BypassState::active};
+  FrameCount drainRemaining_{0};
+  size_t silentFrames_{0};
+  bool silenceCleared_{false};
+  FrameCount skippedFrames_{0};
+
+  WorkerPool workers_;
+  size_t parallelChannelCount_{8};
+
+  // The latest value posted for each parameter, with a count of the posts and of the posts that were applied so that
+  // other threads can tell if a posted value is still pending. The bits of `postedChanges_` mark the parameters that
+  // have a value to apply.
+  static_assert(maxParameterCount <= 32, "too many parameters for the posted changes mask");
+  std::array<std::atomic<Value>, maxParameterCount> postedValues_{};
+  std::array<std::atomic<uint32_t>, maxParameterCount> postedSequences_{};
+  std::array<std::atomic<uint32_t>, maxParameterCount> appliedSequences_{};
+  std::atomic<uint32_t> postedChanges_{0};
+
+  ParameterObserver observer_{nullptr};
+  void* observerContext_{nullptr};
+  SampleTime sampleTime_{0};
+
+  RenderStatistics statistics_;
+  std::atomic<bool> instrumentationEnabled_{false};
+};
+
+} // end namespace Chorus
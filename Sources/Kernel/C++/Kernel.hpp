@@ -3,36 +3,51 @@
 #pragma once
 
 #include <mach/mach.h>
+#include <mach/mach_time.h>
 
-#import <algorithm>
-#import <numeric>
+#import <atomic>
+#import <cstdint>
 #import <string>
+#import <thread>
 #import <AVFoundation/AVFoundation.h>
 
-#import "DSPHeaders/BoolParameter.hpp"
 #import "DSPHeaders/BusBuffers.hpp"
-#import "DSPHeaders/DelayBuffer.hpp"
 #import "DSPHeaders/EventProcessor.hpp"
-#import "DSPHeaders/MillisecondsParameter.hpp"
-#import "DSPHeaders/LFO.hpp"
-#import "DSPHeaders/PercentageParameter.hpp"
+
+#import "DenormalGuard.hpp"
+#import "Engine.hpp"
+#import "SPSCQueue.hpp"
 
 /**
- The audio processing kernel that generates a "chorus" effect by combining an audio signal with a slightly delayed copy
- of itself. The delay value oscillates at a defined frequency which causes the delayed audio to vary in pitch due to it
- being sped up or slowed down.
+ The audio processing kernel of the audio unit. All of the rendering is done by `Chorus::Engine`; the kernel connects
+ it to the audio unit render protocol -- formats, render blocks, the realtime event list and render flags -- and
+ traces parameter changes to the log.
+
+ @param T the type to process samples with
+ @param Storage the policy that holds the per-frame work buffers -- `Chorus::VectorStorage` or
+ `Chorus::FixedStorage`
  */
-class Kernel : public DSPHeaders::EventProcessor<Kernel> {
+template <typename T, typename Storage = Chorus::VectorStorage>
+class BasicKernel : public DSPHeaders::EventProcessor<BasicKernel<T, Storage>>, public Chorus::Engine<T, Storage> {
 public:
-  using super = DSPHeaders::EventProcessor<Kernel>;
+  using super = DSPHeaders::EventProcessor<BasicKernel<T, Storage>>;
+  using Engine = Chorus::Engine<T, Storage>;
   friend super;
 
+  using Engine::setBypass;
+  using Engine::isBypassed;
+
   /**
    Construct new kernel
 
    @param name the name to use for logging purposes.
    */
-  Kernel(std::string name) noexcept : super(name) {}
+  BasicKernel(std::string name) noexcept : super(name) {
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    nanosPerTick_ = double(timebase.numer) / double(timebase.denom);
+    Engine::setParameterObserver(&BasicKernel::traceParameter, this);
+  }
 
   /**
    Update kernel and buffers to support the given format and channel count
@@ -43,129 +58,174 @@ public:
    @param maxDelayMilliseconds the max number of milliseconds of audio samples to keep in delay buffer
    */
   void setRenderingFormat(NSInteger busCount, AVAudioFormat* format, AUAudioFrameCount maxFramesToRender,
-                          double maxDelayMilliseconds) noexcept {
+                          double maxDelayMilliseconds) {
     super::setRenderingFormat(busCount, format, maxFramesToRender);
-    initialize(format.channelCount, format.sampleRate, maxDelayMilliseconds);
+    Engine::configure(int(busCount), format.channelCount, format.sampleRate, maxFramesToRender, maxDelayMilliseconds);
+    if (Engine::maxFramesToRender() < maxFramesToRender) {
+      os_log_with_type(log_, OS_LOG_TYPE_ERROR, "maxFramesToRender %u limited to %u", maxFramesToRender,
+                       Engine::maxFramesToRender());
+    }
+
+    os_log_with_type(log_, OS_LOG_TYPE_INFO, "delayLine size: %f",
+                     Engine::delayLineSizeFor(format.sampleRate, maxDelayMilliseconds));
+    if (Engine::delayLinesGrew()) os_log_with_type(log_, OS_LOG_TYPE_INFO, "delay line pool grown");
+    formatChanged_.store(true, std::memory_order_release);
+  }
+
+  /**
+   Render audio samples. Parameter changes posted by `postParameterValue` are applied first, followed by those in the
+   realtime event list.
+
+   @param timestamp the timestamp of the first sample
+   @param frameCount the number of frames to render
+   @param outputBusNumber the bus to render
+   @param output the buffers to hold the rendered samples
+   @param realtimeEventListHead the first event in the list of events to apply during rendering
+   @param pullInputBlock the block to use to obtain input samples
+   @param actionFlags the render flags of the render call. If given, `kAudioUnitRenderAction_OutputIsSilence` is set
+   when all of the frames rendered were skipped because the input and the delay lines were silent.
+   @returns status of the rendering
+   */
+  AUAudioUnitStatus processAndRender(const AudioTimeStamp* timestamp, AUAudioFrameCount frameCount,
+                                     NSInteger outputBusNumber, AudioBufferList* output,
+                                     const AURenderEvent* realtimeEventListHead,
+                                     AURenderPullInputBlock pullInputBlock,
+                                     AudioUnitRenderActionFlags* actionFlags = nullptr) noexcept {
+    if (outputBusNumber < 0 || size_t(outputBusNumber) >= Engine::busCount()) return kAudioUnitErr_InvalidElement;
+    if (frameCount > Engine::maxFramesToRender()) return kAudioUnitErr_TooManyFramesToProcess;
+    Chorus::DenormalGuard denormalGuard;
+    renderThread_.store(std::this_thread::get_id(), std::memory_order_relaxed);
+    Engine::setEventSampleTime(AUEventSampleTime(timestamp->mSampleTime));
+    Engine::beginCycle(timestamp->mSampleTime, size_t(outputBusNumber));
+    if (formatChanged_.exchange(false, std::memory_order_acquire)) {
+      trace(TraceKind::formatChange, AUEventSampleTime(timestamp->mSampleTime), 0, AUValue(Engine::sampleRate()),
+            AUAudioFrameCount(Engine::channelCount()));
+    }
+
+    AUAudioUnitStatus status;
+    if (!Engine::isInstrumentationEnabled()) {
+      if (!Engine::isReplaying()) Engine::applyPostedParameterValues();
+      status = super::processAndRender(timestamp, frameCount, outputBusNumber, output, realtimeEventListHead,
+                                       pullInputBlock);
+    } else {
+      auto start = mach_absolute_time();
+      if (!Engine::isReplaying()) Engine::applyPostedParameterValues();
+      status = super::processAndRender(timestamp, frameCount, outputBusNumber, output, realtimeEventListHead,
+                                       pullInputBlock);
+      Engine::recordRender(frameCount, uint64_t(double(mach_absolute_time() - start) * nanosPerTick_));
+    }
+
+    if (actionFlags != nullptr && status == noErr && Engine::skippedFrames() == frameCount) {
+      *actionFlags |= kAudioUnitRenderAction_OutputIsSilence;
+    }
+    return status;
   }
 
   /**
-   Process an AU parameter value change by updating the kernel.
+   Post an AU parameter value change from a thread other than the render thread. The change is applied at the start
+   of the next render call. Several changes to the same parameter that arrive between render calls are coalesced so
+   that only the last one is applied.
 
    @param address the address of the parameter that changed
    @param value the new value for the parameter
-   @param rampDuration number of frames to ramp to the new value
+   @returns false if there is no parameter at the address
    */
-  void setParameterValue(AUParameterAddress address, AUValue value, AUAudioFrameCount rampDuration) noexcept;
+  bool postParameterValue(AUParameterAddress address, AUValue value) noexcept {
+    if (Engine::postParameterValue(address, value)) return true;
+    os_log_with_type(log_, OS_LOG_TYPE_ERROR, "postParameterValue - invalid address %llu", address);
+    return false;
+  }
 
   /**
-   Obtain from the kernel the current value of an AU parameter.
-
-   @param address the address of the parameter to return
-   @returns current parameter value
+   Write out the trace events recorded by the render thread to the log. This must be called periodically from one
+   thread that is not the render thread.
    */
-  AUValue getParameterValue(AUParameterAddress address) const noexcept;
+  void flushTrace() noexcept {
+    TraceEvent event;
+    while (traceEvents_.pop(event)) {
+      switch (event.kind) {
+        case TraceKind::parameterChange:
+          os_log_with_type(log_, OS_LOG_TYPE_DEBUG, "%lld: parameter %llu = %f", event.sampleTime,
+                           (unsigned long long)event.address, event.value);
+          break;
+        case TraceKind::rampStart:
+          os_log_with_type(log_, OS_LOG_TYPE_DEBUG, "%lld: parameter %llu ramping to %f over %u frames",
+                           event.sampleTime, (unsigned long long)event.address, event.value, event.frames);
+          break;
+        case TraceKind::formatChange:
+          os_log_with_type(log_, OS_LOG_TYPE_INFO, "%lld: rendering %u channels at %f", event.sampleTime,
+                           event.frames, event.value);
+          break;
+      }
+    }
 
-private:
-  using DelayLine = DSPHeaders::DelayBuffer<AUValue>;
-  using LFO = DSPHeaders::LFO<AUValue>;
-
-  void initialize(int channelCount, double sampleRate, double maxDelayMilliseconds) noexcept {
-    samplesPerMillisecond_ = sampleRate / 1000.0;
-
-    auto rate{rate_.get()};
-    lfo_.setSampleRate(sampleRate);
-    lfo_.setWaveform(LFOWaveform::sinusoid);
-    lfo_.setFrequency(rate, 0.0);
-
-    // Size of delay buffer needs to be twice the maxDelay value since at max delay and max depth settings, the bipolar
-    // indices into the delay buffer will go from delay * -1 * depth to delay * 1 * depth (approximately).
-    auto size = maxDelayMilliseconds * samplesPerMillisecond_ * 2.0 + 1;
-    os_log_with_type(log_, OS_LOG_TYPE_INFO, "delayLine size: %f", size);
-    delayLines_.clear();
-    for (auto index = 0; index < channelCount; ++index) {
-      delayLines_.emplace_back(size, DelayLine::Interpolator::cubic4thOrder);
+    auto dropped = droppedTraceEvents_.exchange(0, std::memory_order_relaxed);
+    if (dropped > 0) {
+      os_log_with_type(log_, OS_LOG_TYPE_INFO, "dropped %u trace events", dropped);
     }
   }
 
-  void setRate(AUValue rate, AUAudioFrameCount rampingDuration) {
-    rate_.set(rate, rampingDuration);
-    lfo_.setFrequency(rate, rampingDuration);
+private:
+  using super::log_;
+
+  enum class TraceKind { parameterChange, rampStart, formatChange };
+
+  struct TraceEvent {
+    TraceKind kind;
+    AUEventSampleTime sampleTime;
+    AUParameterAddress address;
+    AUValue value;
+    AUAudioFrameCount frames;
+  };
+
+  /**
+   Record an event in the trace buffer. Safe to use on the render thread -- it never blocks, allocates or logs. If the
+   buffer is full the event is counted and dropped. The buffer only has room for one thread to write to it, so events
+   from any other thread -- such as a parameter set directly from the main thread -- are not recorded.
+   */
+  void trace(TraceKind kind, AUEventSampleTime sampleTime, AUParameterAddress address, AUValue value,
+             AUAudioFrameCount frames) noexcept {
+    if (std::this_thread::get_id() != renderThread_.load(std::memory_order_relaxed)) return;
+    if (!traceEvents_.push({kind, sampleTime, address, value, frames})) {
+      droppedTraceEvents_.fetch_add(1, std::memory_order_relaxed);
+    }
   }
 
-  void setParameterFromEvent(const AUParameterEvent& event) noexcept {
-    setParameterValue(event.parameterAddress, event.value, event.rampDurationSampleFrames);
+  /// Parameter observer of the engine that records each change in the trace buffer.
+  static void traceParameter(void* context, AUEventSampleTime sampleTime, AUParameterAddress address, AUValue value,
+                             AUAudioFrameCount duration) noexcept {
+    static_cast<BasicKernel*>(context)->trace(duration > 0 ? TraceKind::rampStart : TraceKind::parameterChange,
+                                              sampleTime, address, value, duration);
   }
 
   void doRendering(NSInteger outputBusNumber, DSPHeaders::BusBuffers ins, DSPHeaders::BusBuffers outs,
                    AUAudioFrameCount frameCount) noexcept {
-
-    // If ramping one or more parameters, we must render one frame at a time. Since this is more expensive than the
-    // non-ramp case, we only do it when necessary.
-    auto rampCount = std::min(rampRemaining_, frameCount);
-    if (rampCount > 0) {
-      rampRemaining_ -= rampCount;
-      for (; rampCount > 0; --rampCount, --frameCount) {
-        renderFrames(1, ins, outs);
-      }
-    }
-
-    // Non-ramping case
-    if (frameCount > 0) {
-      renderFrames(frameCount, ins, outs);
-    }
+    Engine::render(Chorus::ChannelBuffers{ins.size() > 0 ? &ins[0] : nullptr, ins.size()},
+                   Chorus::ChannelBuffers{outs.size() > 0 ? &outs[0] : nullptr, outs.size()}, frameCount);
   }
 
-  void renderFrames(AUAudioFrameCount frameCount, DSPHeaders::BusBuffers ins, DSPHeaders::BusBuffers outs) noexcept {
-
-    // Nominal position of tap into delay line
-    auto tap = delay_.frameValue();
-
-    // Fraction of overall displacement available to move the tap
-    auto displacementFraction = depth_.frameValue();
-    assert(displacementFraction >= 0.0 && displacementFraction <= 1.0);
-
-    // Displacement is the distance from the nominal tap to a non-zero min value.
-    constexpr AUValue minTap = 1.0E-3;
-    auto displacement = std::max<AUValue>(tap - minTap, 0.0) * displacementFraction;
-
-    auto wetMix = wetMix_.frameValue();
-    assert(wetMix >= 0.0 && wetMix <= 1.0);
-    auto dryMix = dryMix_.frameValue();
-    assert(dryMix >= 0.0 && dryMix <= 1.0);
-
-    auto odd90 = odd90_.get();
-
-    // Generate frames
-    for (; frameCount > 0; --frameCount) {
-      auto evenDelay = lfo_.value() * displacement + tap;
-      auto oddDelay = lfo_.quadPhaseValue() * displacement + tap;
-      lfo_.increment();
-
-      // Generate samples for each channel
-      for (int channel = 0; channel < ins.size(); ++channel) {
-        auto inputSample = *ins[channel]++;
-        auto delayedSample = inputSample;
-        if (displacement) {
-          delayedSample = delayLines_[channel].read(((channel & 1) && odd90) ? oddDelay : evenDelay);
-          delayLines_[channel].write(inputSample);
-        }
-        *outs[channel]++ = wetMix * delayedSample + dryMix * inputSample;
-      }
-    }
+  void setParameterFromEvent(const AUParameterEvent& event) noexcept {
+    Engine::setEventSampleTime(event.eventSampleTime);
+
+    // The bus that led the render cycle already applied the events.
+    if (Engine::isReplaying()) return;
+    Engine::setParameterValue(event.parameterAddress, event.value, event.rampDurationSampleFrames);
   }
 
   void doMIDIEvent(const AUMIDIEvent& midiEvent) noexcept {}
 
-  DSPHeaders::Parameters::RampingParameter<AUValue> rate_;
-  DSPHeaders::Parameters::PercentageParameter<AUValue> depth_;
-  DSPHeaders::Parameters::MillisecondsParameter<AUValue> delay_;
-  DSPHeaders::Parameters::PercentageParameter<AUValue> dryMix_;
-  DSPHeaders::Parameters::PercentageParameter<AUValue> wetMix_;
-  DSPHeaders::Parameters::BoolParameter odd90_;
+  Chorus::SPSCQueue<TraceEvent, 1024> traceEvents_;
+  std::atomic<uint32_t> droppedTraceEvents_{0};
+  std::atomic<bool> formatChanged_{false};
+  std::atomic<std::thread::id> renderThread_{};
+  double nanosPerTick_{1.0};
+};
 
-  double samplesPerMillisecond_;
+/// The kernel used by the audio unit: 32-bit float processing with work buffers sized at run time.
+using Kernel = BasicKernel<AUValue>;
 
-  std::vector<DelayLine> delayLines_;
-  LFO lfo_;
-  AUAudioFrameCount rampRemaining_;
-};
+/// Kernel with 64-bit float processing for long renders that must not drift.
+using DoubleKernel = BasicKernel<double>;
+
+/// Kernel with 32-bit float processing and inline work buffers for up to 4096 frames per render call.
+using FixedKernel = BasicKernel<AUValue, Chorus::FixedStorage<4096>>;
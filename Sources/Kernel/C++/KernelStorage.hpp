@@ -0,0 +1,79 @@
+// Copyright © 2022 Brad Howes. All rights reserved.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+namespace Chorus {
+
+/**
+ Buffer with room for a fixed number of values that are held inline, with the parts of the `std::vector` interface
+ that the kernel uses for its work buffers. Nothing is ever allocated, and since the values are part of the object
+ that holds the buffer, reaching them takes no pointer load.
+
+ @param V the type of value to hold
+ @param Capacity the max number of values
+ */
+template <typename V, size_t Capacity>
+class FixedBuffer {
+public:
+  /// Does nothing -- the capacity is fixed. Present so that the buffer can stand in for a `std::vector`.
+  void reserve(size_t) noexcept {}
+
+  /**
+   Set the number of values in use.
+
+   @param size the number of values. Must not be more than `Capacity`.
+   */
+  void resize(size_t size) noexcept {
+    assert(size <= Capacity);
+    size_ = std::min(size, Capacity);
+  }
+
+  /// @returns the number of values in use
+  size_t size() const noexcept { return size_; }
+
+  V* data() noexcept { return values_.data(); }
+  const V* data() const noexcept { return values_.data(); }
+
+  V& operator[](size_t index) noexcept { return values_[index]; }
+  const V& operator[](size_t index) const noexcept { return values_[index]; }
+
+private:
+  std::array<V, Capacity> values_{};
+  size_t size_{0};
+};
+
+/**
+ Storage policy for the per-frame work buffers of the kernel that sizes them at run time for any render size. This is
+ the policy of `Kernel`.
+ */
+struct VectorStorage {
+  /// The max number of frames in one render call. 0 means that there is no limit.
+  static constexpr size_t maxFrames = 0;
+
+  template <typename V, size_t Capacity>
+  using Buffer = std::vector<V>;
+};
+
+/**
+ Storage policy for the per-frame work buffers of the kernel that holds them inline with room for a fixed number of
+ frames. The kernel then has no heap indirection in its render loops, at the cost of a larger kernel object and a
+ compile-time limit on the render size.
+
+ @param MaxFrames the max number of frames in one render call
+ */
+template <size_t MaxFrames>
+struct FixedStorage {
+  static_assert(MaxFrames > 0, "MaxFrames must not be 0");
+  static constexpr size_t maxFrames = MaxFrames;
+
+  template <typename V, size_t Capacity>
+  using Buffer = FixedBuffer<V, Capacity>;
+};
+
+} // end namespace Chorus
@@ -0,0 +1,240 @@
+// Copyright © 2022 Brad Howes. All rights reserved.
+
+#pragma once
+
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+
+namespace Chorus {
+
+/**
+ Sinusoidal low-frequency oscillator that generates a value and its 90° (quadrature) companion by rotating a unit
+ vector by a fixed angle each frame. Generating a block of values needs only multiplies and adds -- `std::sin` and
+ `std::cos` are only evaluated when the frequency changes.
+
+ A frequency change can ramp over a number of frames. During the ramp the rotation angle itself is advanced by a second
+ rotation so the per-frame cost stays the same.
+
+ At high sample rates the oscillator barely moves from one frame to the next. With a control interval greater than 1,
+ `fill` only rotates the vector once per interval and interpolates linearly between the rotations. `fill` can also map
+ the values onto a range as it goes, which folds that interpolation into the mapping that the caller needs anyway.
+ */
+template <typename T>
+class QuadratureLFO {
+public:
+
+  /**
+   Set the sample rate to use. Resets the rotation for the current frequency.
+
+   @param sampleRate the number of frames per second
+   */
+  void setSampleRate(double sampleRate) noexcept {
+    assert(sampleRate > 0.0);
+    sampleRate_ = sampleRate;
+    setFrequency(frequency_, 0);
+  }
+
+  /**
+   Set the frequency of the oscillator.
+
+   @param frequency the new frequency in Hertz
+   @param rampDuration the number of frames to take to get to the new frequency
+   */
+  void setFrequency(T frequency, size_t rampDuration) noexcept {
+    if (rampDuration == 0) {
+      frequency_ = frequency;
+      rampRemaining_ = 0;
+      setRotation(stepCos_, stepSin_, angleFor(frequency));
+      updateControlRotation();
+      return;
+    }
+
+    // Linear ramp of the per-frame angle: rotate the step rotation by a constant delta each frame.
+    auto current = currentFrequency();
+    frequency_ = frequency;
+    rampRemaining_ = rampDuration;
+    setRotation(stepCos_, stepSin_, angleFor(current));
+    setRotation(rampCos_, rampSin_, (angleFor(frequency) - angleFor(current)) / T(rampDuration));
+  }
+
+  /**
+   Set how often `fill` evaluates the oscillator outside of a frequency ramp. Frames between evaluations are
+   linearly interpolated.
+
+   @param interval the number of frames between evaluations. Must be at least 1.
+   */
+  void setControlInterval(size_t interval) noexcept {
+    assert(interval > 0);
+    controlInterval_ = interval;
+    updateControlRotation();
+  }
+
+  /// @returns the current value of the oscillator -- sin(phase)
+  T value() const noexcept { return sin_; }
+
+  /// @returns the current value of the oscillator 90° ahead -- cos(phase)
+  T quadPhaseValue() const noexcept { return cos_; }
+
+  /// @returns the current phase of the oscillator in radians
+  T phase() const noexcept { return std::atan2(sin_, cos_); }
+
+  /**
+   Move the oscillator to a new phase. Does not affect the frequency or an active frequency ramp.
+
+   @param phase the new phase in radians
+   */
+  void setPhase(T phase) noexcept { setRotation(cos_, sin_, phase); }
+
+  /// Advance the oscillator by one frame.
+  void increment() noexcept {
+    rotate();
+    if (rampRemaining_ > 0) advanceRamp();
+  }
+
+  /**
+   Generate values for a block of frames, advancing the oscillator by `count` frames.
+
+   @param values the destination for `value()` for each frame
+   @param quadPhaseValues the destination for `quadPhaseValue()` for each frame
+   @param count the number of frames to generate
+   */
+  void fill(T* values, T* quadPhaseValues, size_t count) noexcept { fill(values, quadPhaseValues, count, 1, 0); }
+
+  /**
+   Generate values for a block of frames mapped onto a range, advancing the oscillator by `count` frames. Each output
+   is `offset + scale * value`, so a caller such as the delay calculation of the kernel needs no second pass over the
+   values. Between control points the mapped value is interpolated directly, which is one multiply-add per output --
+   the same as the mapping alone -- instead of a rotation per frame.
+
+   @param values the destination for the mapped `value()` for each frame
+   @param quadPhaseValues the destination for the mapped `quadPhaseValue()` for each frame
+   @param count the number of frames to generate
+   @param scale the factor to apply to the values
+   @param offset the amount to add to the scaled values
+   */
+  void fill(T* values, T* quadPhaseValues, size_t count, T scale, T offset) noexcept {
+    size_t frame = 0;
+    for (; rampRemaining_ > 0 && frame < count; ++frame) {
+      values[frame] = offset + scale * sin_;
+      quadPhaseValues[frame] = offset + scale * cos_;
+      rotate();
+      advanceRamp();
+    }
+
+    auto sin = sin_;
+    auto cos = cos_;
+    if (controlInterval_ > 1) {
+      auto interval = controlInterval_;
+      auto stepScale = scale / T(interval);
+      for (; frame + interval <= count; frame += interval) {
+        auto nextSin = sin * controlCos_ + cos * controlSin_;
+        auto nextCos = cos * controlCos_ - sin * controlSin_;
+        auto baseSin = offset + scale * sin;
+        auto baseCos = offset + scale * cos;
+        auto deltaSin = (nextSin - sin) * stepScale;
+        auto deltaCos = (nextCos - cos) * stepScale;
+        for (size_t step = 0; step < interval; ++step) {
+          values[frame + step] = baseSin + deltaSin * T(step);
+          quadPhaseValues[frame + step] = baseCos + deltaCos * T(step);
+        }
+        sin = nextSin;
+        cos = nextCos;
+      }
+    }
+
+    // Any frames left over are generated one at a time.
+    auto stepCos = stepCos_;
+    auto stepSin = stepSin_;
+    for (; frame < count; ++frame) {
+      values[frame] = offset + scale * sin;
+      quadPhaseValues[frame] = offset + scale * cos;
+      auto nextSin = sin * stepCos + cos * stepSin;
+      cos = cos * stepCos - sin * stepSin;
+      sin = nextSin;
+    }
+
+    sin_ = sin;
+    cos_ = cos;
+    normalize();
+  }
+
+  /**
+   Advance the oscillator by `count` frames without generating any values. Outside of a frequency ramp this is one
+   rotation by the combined angle, so it costs the same regardless of `count`.
+
+   @param count the number of frames to skip
+   */
+  void skip(size_t count) noexcept {
+    for (; rampRemaining_ > 0 && count > 0; --count) {
+      rotate();
+      advanceRamp();
+    }
+
+    if (count == 0) return;
+    auto angle = std::atan2(double(stepSin_), double(stepCos_)) * double(count);
+    auto cos = T(std::cos(angle));
+    auto sin = T(std::sin(angle));
+    auto nextSin = sin_ * cos + cos_ * sin;
+    cos_ = cos_ * cos - sin_ * sin;
+    sin_ = nextSin;
+    normalize();
+  }
+
+private:
+
+  T angleFor(T frequency) const noexcept { return T(2.0 * M_PI * frequency / sampleRate_); }
+
+  T currentFrequency() const noexcept { return std::atan2(stepSin_, stepCos_) * T(sampleRate_ / (2.0 * M_PI)); }
+
+  static void setRotation(T& cos, T& sin, T angle) noexcept {
+    cos = std::cos(angle);
+    sin = std::sin(angle);
+  }
+
+  void rotate() noexcept {
+    auto nextSin = sin_ * stepCos_ + cos_ * stepSin_;
+    cos_ = cos_ * stepCos_ - sin_ * stepSin_;
+    sin_ = nextSin;
+  }
+
+  void advanceRamp() noexcept {
+    if (--rampRemaining_ == 0) {
+      // Land exactly on the target rotation so that rounding during the ramp does not linger.
+      setRotation(stepCos_, stepSin_, angleFor(frequency_));
+      updateControlRotation();
+      normalize();
+      return;
+    }
+
+    auto nextSin = stepSin_ * rampCos_ + stepCos_ * rampSin_;
+    stepCos_ = stepCos_ * rampCos_ - stepSin_ * rampSin_;
+    stepSin_ = nextSin;
+  }
+
+  void updateControlRotation() noexcept {
+    setRotation(controlCos_, controlSin_, angleFor(frequency_) * T(controlInterval_));
+  }
+
+  /// Pull the phase vector back onto the unit circle. Rounding in the recursion slowly changes its magnitude.
+  void normalize() noexcept {
+    auto scale = T(1.5) - T(0.5) * (sin_ * sin_ + cos_ * cos_);
+    sin_ *= scale;
+    cos_ *= scale;
+  }
+
+  double sampleRate_{44100.0};
+  T frequency_{1.0};
+  T sin_{0.0};
+  T cos_{1.0};
+  T stepCos_{1.0};
+  T stepSin_{0.0};
+  T rampCos_{1.0};
+  T rampSin_{0.0};
+  T controlCos_{1.0};
+  T controlSin_{0.0};
+  size_t controlInterval_{1};
+  size_t rampRemaining_{0};
+};
+
+} // end namespace Chorus
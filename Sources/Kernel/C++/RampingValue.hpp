@@ -0,0 +1,67 @@
+// Copyright © 2022 Brad Howes. All rights reserved.
+
+#pragma once
+
+#include "Types.hpp"
+
+namespace Chorus {
+
+/**
+ A setting that moves to a new value in a straight line over a number of frames. Values are set and reported in the
+ units of the parameter they hold, and are scaled when rendering, so that for instance a percentage is set as 50 and
+ rendered as 0.5.
+
+ @param T the type of value to hold
+ */
+template <typename T>
+class RampingValue {
+public:
+
+  /**
+   Construct a new value.
+
+   @param scale the factor that turns the value into the one used for rendering
+   @param value the initial value
+   */
+  explicit RampingValue(T scale = T(1), T value = T(0)) noexcept : scale_{scale}, target_{value}, current_{value} {}
+
+  /**
+   Set a new value.
+
+   @param target the value to move to
+   @param duration the number of frames to take to get there. With 0 the change happens at once.
+   */
+  void set(T target, FrameCount duration) noexcept {
+    target_ = target;
+    if (duration == 0) {
+      current_ = target;
+      step_ = T(0);
+    } else {
+      step_ = (target - current_) / T(duration);
+    }
+    remaining_ = duration;
+  }
+
+  /// @returns the value being moved to, in parameter units
+  T get() const noexcept { return target_; }
+
+  /// @returns true if the value is still moving
+  bool isRamping() const noexcept { return remaining_ > 0; }
+
+  /// @returns the scaled value for the next frame, moving it on by one frame if it is ramping
+  T frameValue() noexcept {
+    if (remaining_ > 0) {
+      current_ = --remaining_ == 0 ? target_ : current_ + step_;
+    }
+    return current_ * scale_;
+  }
+
+private:
+  T scale_;
+  T target_;
+  T current_;
+  T step_{0};
+  FrameCount remaining_{0};
+};
+
+} // end namespace Chorus
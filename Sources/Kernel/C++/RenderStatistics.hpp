@@ -0,0 +1,144 @@
+// Copyright © 2022 Brad Howes. All rights reserved.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace Chorus {
+
+/**
+ Counters that describe the cost of render calls. Values are recorded by the render thread and can be read from any
+ other thread via `snapshot`. All counters are relaxed atomics, so a snapshot taken while rendering is in progress may
+ mix values from adjacent render calls, but recording never blocks or allocates.
+
+ Render durations are also tallied in a histogram with four buckets per octave which is used to estimate the 99th
+ percentile duration.
+ */
+class RenderStatistics {
+public:
+
+  /// Copy of the counters at one point in time. All durations are in nanoseconds.
+  struct Snapshot {
+    uint64_t renderCount;
+    uint64_t frameCount;
+    uint64_t minDuration;
+    uint64_t maxDuration;
+    double averageDuration;
+    uint64_t p99Duration;
+    /// Ratio of total render time to the total time available for rendering
+    double load;
+    uint64_t rampRenderCount;
+    uint64_t rampFrameCount;
+    uint64_t deadlineOverrunCount;
+  };
+
+  /**
+   Record the duration of a render call.
+
+   @param frameCount the number of frames that were rendered
+   @param duration the time taken to render the frames in nanoseconds
+   @param deadline the time the frames represent in nanoseconds -- taking longer than this is an overrun
+   */
+  void recordRender(uint32_t frameCount, uint64_t duration, uint64_t deadline) noexcept {
+    increment(renderCount_, 1);
+    increment(frameCount_, frameCount);
+    increment(totalDuration_, duration);
+    increment(totalDeadline_, deadline);
+    if (duration < minDuration_.load(std::memory_order_relaxed)) {
+      minDuration_.store(duration, std::memory_order_relaxed);
+    }
+    if (duration > maxDuration_.load(std::memory_order_relaxed)) {
+      maxDuration_.store(duration, std::memory_order_relaxed);
+    }
+    if (duration > deadline) increment(deadlineOverrunCount_, 1);
+    increment(histogram_[bucketFor(duration)], 1);
+  }
+
+  /**
+   Record the rendering of a segment with ramping parameters.
+
+   @param frameCount the number of frames in the segment
+   */
+  void recordRamp(uint32_t frameCount) noexcept {
+    increment(rampRenderCount_, 1);
+    increment(rampFrameCount_, frameCount);
+  }
+
+  /// @returns copy of the current counter values
+  Snapshot snapshot() const noexcept {
+    Snapshot result;
+    result.renderCount = renderCount_.load(std::memory_order_relaxed);
+    result.frameCount = frameCount_.load(std::memory_order_relaxed);
+    result.minDuration = result.renderCount > 0 ? minDuration_.load(std::memory_order_relaxed) : 0;
+    result.maxDuration = maxDuration_.load(std::memory_order_relaxed);
+    auto total = totalDuration_.load(std::memory_order_relaxed);
+    auto deadline = totalDeadline_.load(std::memory_order_relaxed);
+    result.averageDuration = result.renderCount > 0 ? double(total) / double(result.renderCount) : 0.0;
+    result.load = deadline > 0 ? double(total) / double(deadline) : 0.0;
+    result.p99Duration = percentile(0.99, result.renderCount);
+    result.rampRenderCount = rampRenderCount_.load(std::memory_order_relaxed);
+    result.rampFrameCount = rampFrameCount_.load(std::memory_order_relaxed);
+    result.deadlineOverrunCount = deadlineOverrunCount_.load(std::memory_order_relaxed);
+    return result;
+  }
+
+  /// Set all counters back to zero.
+  void reset() noexcept {
+    for (auto counter : {&renderCount_, &frameCount_, &totalDuration_, &totalDeadline_, &maxDuration_,
+                         &rampRenderCount_, &rampFrameCount_, &deadlineOverrunCount_}) {
+      counter->store(0, std::memory_order_relaxed);
+    }
+    minDuration_.store(UINT64_MAX, std::memory_order_relaxed);
+    for (auto& bucket : histogram_) bucket.store(0, std::memory_order_relaxed);
+  }
+
+private:
+  static constexpr size_t bucketsPerOctave = 4;
+  static constexpr size_t bucketCount = 64 * bucketsPerOctave;
+
+  /// Only the render thread writes, so a load + store is enough and avoids a read-modify-write instruction.
+  static void increment(std::atomic<uint64_t>& counter, uint64_t amount) noexcept {
+    counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+  }
+
+  static size_t bucketFor(uint64_t duration) noexcept {
+    if (duration < bucketsPerOctave) return size_t(duration);
+    auto octave = size_t(63 - __builtin_clzll(duration));
+    auto step = size_t(duration >> (octave - 2)) & (bucketsPerOctave - 1);
+    return octave * bucketsPerOctave + step;
+  }
+
+  static uint64_t bucketUpperBound(size_t bucket) noexcept {
+    if (bucket < bucketsPerOctave) return bucket;
+    auto octave = bucket / bucketsPerOctave;
+    auto step = bucket % bucketsPerOctave;
+    return ((uint64_t(bucketsPerOctave + step + 1)) << (octave - 2)) - 1;
+  }
+
+  uint64_t percentile(double fraction, uint64_t count) const noexcept {
+    if (count == 0) return 0;
+    auto threshold = uint64_t(fraction * double(count));
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < bucketCount; ++bucket) {
+      seen += histogram_[bucket].load(std::memory_order_relaxed);
+      if (seen > threshold) return std::min(bucketUpperBound(bucket), maxDuration_.load(std::memory_order_relaxed));
+    }
+    return maxDuration_.load(std::memory_order_relaxed);
+  }
+
+  std::atomic<uint64_t> renderCount_{0};
+  std::atomic<uint64_t> frameCount_{0};
+  std::atomic<uint64_t> totalDuration_{0};
+  std::atomic<uint64_t> totalDeadline_{0};
+  std::atomic<uint64_t> minDuration_{UINT64_MAX};
+  std::atomic<uint64_t> maxDuration_{0};
+  std::atomic<uint64_t> rampRenderCount_{0};
+  std::atomic<uint64_t> rampFrameCount_{0};
+  std::atomic<uint64_t> deadlineOverrunCount_{0};
+  std::array<std::atomic<uint64_t>, bucketCount> histogram_{};
+};
+
+} // end namespace Chorus
@@ -0,0 +1,62 @@
+// Copyright © 2022 Brad Howes. All rights reserved.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+namespace Chorus {
+
+/**
+ Fixed-capacity queue that can be safely used by one producer thread and one consumer thread without locks. Neither
+ side ever allocates or blocks, so it is suitable for passing values to or from the audio render thread.
+
+ @param T the type of value held in the queue. Must be trivially copyable.
+ @param Capacity the max number of values held in the queue. Must be a power of 2.
+ */
+template <typename T, size_t Capacity>
+class SPSCQueue {
+  static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of 2");
+public:
+
+  /**
+   Add a value to the queue. Must only be called by the producer thread.
+
+   @param value the value to add
+   @returns false if the queue is full and the value was not added
+   */
+  bool push(const T& value) noexcept {
+    auto tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) == Capacity) return false;
+    values_[tail & mask] = value;
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   Remove the oldest value from the queue. Must only be called by the consumer thread.
+
+   @param value the location to hold the removed value
+   @returns false if the queue is empty
+   */
+  bool pop(T& value) noexcept {
+    auto head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire)) return false;
+    value = values_[head & mask];
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  /// @returns true if there are no values in the queue. Only a hint when used from the producer thread.
+  bool empty() const noexcept { return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire); }
+
+private:
+  static constexpr size_t mask = Capacity - 1;
+
+  std::array<T, Capacity> values_;
+  alignas(64) std::atomic<size_t> head_{0};
+  alignas(64) std::atomic<size_t> tail_{0};
+};
+
+} // end namespace Chorus
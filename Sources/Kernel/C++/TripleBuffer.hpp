@@ -0,0 +1,60 @@
+// Copyright © 2022 Brad Howes. All rights reserved.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace Chorus {
+
+/**
+ Hand-off of the latest value of something from one producer thread to one consumer thread without locks. The producer
+ fills a slot that only it uses and then publishes it with one atomic pointer swap. The consumer swaps it out the same
+ way, so neither side ever waits for or copies over the slot that the other is using. Values that are published faster
+ than they are taken are replaced by newer ones.
+
+ @param T the type of value to hand off
+ */
+template <typename T>
+class TripleBuffer {
+public:
+  TripleBuffer() = default;
+  TripleBuffer(const TripleBuffer&) = delete;
+  TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+  /**
+   Make a value available to the consumer. Must only be called by the producer thread.
+
+   @param value the value to publish
+   */
+  void publish(const T& value) noexcept {
+    *back_ = value;
+    auto previous = middle_.exchange(reinterpret_cast<uintptr_t>(back_) | fresh, std::memory_order_acq_rel);
+    back_ = reinterpret_cast<T*>(previous & ~fresh);
+  }
+
+  /**
+   Obtain the latest published value. Must only be called by the consumer thread.
+
+   @returns pointer to the value if one was published since the last call, nullptr otherwise. The value remains valid
+   until the next call.
+   */
+  const T* take() noexcept {
+    if ((middle_.load(std::memory_order_acquire) & fresh) == 0) return nullptr;
+    auto previous = middle_.exchange(reinterpret_cast<uintptr_t>(front_), std::memory_order_acq_rel);
+    front_ = reinterpret_cast<T*>(previous & ~fresh);
+    return front_;
+  }
+
+private:
+  static_assert(alignof(T) > 1, "the low bit of a slot pointer marks a fresh value");
+  static constexpr uintptr_t fresh = 1;
+
+  std::array<T, 3> slots_{};
+  alignas(64) T* back_{&slots_[0]};
+  alignas(64) std::atomic<uintptr_t> middle_{reinterpret_cast<uintptr_t>(&slots_[1])};
+  alignas(64) T* front_{&slots_[2]};
+};
+
+} // end namespace Chorus
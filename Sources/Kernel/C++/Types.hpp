@@ -0,0 +1,37 @@
+// Copyright © 2022 Brad Howes. All rights reserved.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Chorus {
+
+/// Type of the audio samples going in and out of the engine and of parameter values. The same as `AUValue`.
+using Value = float;
+
+/// Type of frame counts. The same as `AUAudioFrameCount`.
+using FrameCount = uint32_t;
+
+/// Type of sample times. The same as `AUEventSampleTime`.
+using SampleTime = int64_t;
+
+/// Type of parameter addresses. The same as `AUParameterAddress`.
+using Address = uint64_t;
+
+/**
+ View of one sample buffer per channel. Rendering moves each pointer past the frames it renders, so a run of render
+ calls works its way through the buffers.
+ */
+struct ChannelBuffers {
+  Value** buffers;
+  size_t count;
+
+  /// @returns the number of channels
+  size_t size() const noexcept { return count; }
+
+  /// @returns the pointer to the next sample of a channel
+  Value*& operator[](size_t channel) const noexcept { return buffers[channel]; }
+};
+
+} // end namespace Chorus
@@ -0,0 +1,195 @@
+// Copyright © 2022 Brad Howes. All rights reserved.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#include <mach/mach_time.h>
+#include <mach/thread_policy.h>
+#include <pthread.h>
+#if __has_include(<os/workgroup.h>)
+#include <os/workgroup.h>
+#define CHORUS_HAS_WORKGROUPS 1
+#endif
+#else
+#include <semaphore.h>
+#endif
+
+#include "DenormalGuard.hpp"
+
+namespace Chorus {
+
+/**
+ Small pool of threads that help the render thread with work that can be split into independent tasks. `run` hands out
+ the tasks to the render thread and the worker threads and only returns once all of them are done, so the tasks may
+ safely refer to values on the render thread's stack.
+
+ Nothing in `run` allocates or takes a lock. Workers sleep on a semaphore between runs, and the render thread sleeps on
+ another one while it waits for them to finish, so a worker that is late does not cost the render thread any CPU time.
+ On Apple platforms the workers run with a real-time scheduling policy and can join the audio workgroup of the host so
+ that the OS schedules them alongside the render thread.
+ */
+class WorkerPool {
+public:
+  using Task = void (*)(void* context, size_t index);
+#if defined(CHORUS_HAS_WORKGROUPS)
+  using Workgroup = os_workgroup_t;
+#else
+  using Workgroup = void*;
+#endif
+
+  WorkerPool() = default;
+  WorkerPool(const WorkerPool&) = delete;
+  WorkerPool& operator=(const WorkerPool&) = delete;
+
+  ~WorkerPool() { stop(); }
+
+  /**
+   Start the worker threads, stopping any that are already running. This allocates and creates threads so it must not
+   be done on the render thread, or while a `run` is in progress.
+
+   @param workerCount the number of threads to start. No threads are started if this is 0.
+   @param workgroup the audio workgroup for the threads to join, or nullptr
+   */
+  void start(size_t workerCount, Workgroup workgroup = nullptr) {
+    stop();
+    stopping_ = false;
+    workgroup_ = workgroup;
+    workers_.reserve(workerCount);
+    for (size_t index = 0; index < workerCount; ++index) {
+      workers_.emplace_back([this] { workerLoop(); });
+    }
+  }
+
+  /// Stop all worker threads and wait for them to exit.
+  void stop() {
+    if (workers_.empty()) return;
+    stopping_ = true;
+    for (size_t index = 0; index < workers_.size(); ++index) wake_.signal();
+    for (auto& worker : workers_) worker.join();
+    workers_.clear();
+  }
+
+  /// @returns the number of worker threads
+  size_t size() const noexcept { return workers_.size(); }
+
+  /**
+   Perform `taskCount` tasks, spreading them over the calling thread and the worker threads. Returns once all tasks
+   are done. Must only be called from one thread at a time.
+
+   @param taskCount the number of tasks to perform
+   @param task the function to call for each task
+   @param context the value to give to `task`
+   */
+  void run(size_t taskCount, Task task, void* context) noexcept {
+    auto helpers = std::min(workers_.size(), taskCount > 0 ? taskCount - 1 : 0);
+    task_ = task;
+    context_ = context;
+    taskCount_ = taskCount;
+    nextTask_.store(0, std::memory_order_relaxed);
+    for (size_t index = 0; index < helpers; ++index) wake_.signal();
+
+    drain();
+
+    // Every worker that was woken checks in once it finds no more tasks, so when they have all done so, all tasks
+    // have been performed and no worker is still looking at this run.
+    for (size_t index = 0; index < helpers; ++index) finished_.wait();
+  }
+
+private:
+
+  /// Counting semaphore that can be signalled from the render thread.
+  class Semaphore {
+  public:
+#if defined(__APPLE__)
+    Semaphore() noexcept { semaphore_create(mach_task_self(), &semaphore_, SYNC_POLICY_FIFO, 0); }
+    ~Semaphore() noexcept { semaphore_destroy(mach_task_self(), semaphore_); }
+    void signal() noexcept { semaphore_signal(semaphore_); }
+    void wait() noexcept { semaphore_wait(semaphore_); }
+  private:
+    semaphore_t semaphore_;
+#else
+    Semaphore() noexcept { sem_init(&semaphore_, 0, 0); }
+    ~Semaphore() noexcept { sem_destroy(&semaphore_); }
+    void signal() noexcept { sem_post(&semaphore_); }
+    void wait() noexcept { while (sem_wait(&semaphore_) != 0) {} }
+  private:
+    sem_t semaphore_;
+#endif
+  };
+
+  void drain() noexcept {
+    for (;;) {
+      auto index = nextTask_.fetch_add(1, std::memory_order_acq_rel);
+      if (index >= taskCount_) break;
+      task_(context_, index);
+    }
+  }
+
+  void workerLoop() noexcept {
+    makeRealtime();
+#if defined(CHORUS_HAS_WORKGROUPS)
+    os_workgroup_join_token_s token;
+    bool joined = false;
+    if (workgroup_ != nullptr) {
+      if (__builtin_available(macOS 11.0, iOS 14.0, *)) {
+        joined = os_workgroup_join(workgroup_, &token) == 0;
+      }
+    }
+#endif
+
+    for (;;) {
+      wake_.wait();
+      if (stopping_) break;
+      {
+        // The tasks render audio just like the render thread, so they need the same floating-point mode.
+        DenormalGuard denormalGuard;
+        drain();
+      }
+      finished_.signal();
+    }
+
+#if defined(CHORUS_HAS_WORKGROUPS)
+    if (joined) {
+      if (__builtin_available(macOS 11.0, iOS 14.0, *)) {
+        os_workgroup_leave(workgroup_, &token);
+      }
+    }
+#endif
+  }
+
+  /// Ask for the same kind of scheduling that audio render threads get.
+  static void makeRealtime() noexcept {
+#if defined(__APPLE__)
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    auto ticksPerMillisecond = 1.0E6 * double(timebase.denom) / double(timebase.numer);
+    thread_time_constraint_policy_data_t policy;
+    policy.period = 0;
+    policy.computation = uint32_t(0.5 * ticksPerMillisecond);
+    policy.constraint = uint32_t(2.0 * ticksPerMillisecond);
+    policy.preemptible = 1;
+    thread_policy_set(pthread_mach_thread_np(pthread_self()), THREAD_TIME_CONSTRAINT_POLICY,
+                      thread_policy_t(&policy), THREAD_TIME_CONSTRAINT_POLICY_COUNT);
+#endif
+  }
+
+  std::vector<std::thread> workers_;
+  Semaphore wake_;
+  Semaphore finished_;
+  Workgroup workgroup_{nullptr};
+  std::atomic<bool> stopping_{false};
+
+  Task task_{nullptr};
+  void* context_{nullptr};
+  size_t taskCount_{0};
+  alignas(64) std::atomic<size_t> nextTask_{0};
+};
+
+} // end namespace Chorus
@@ -1,33 +1,24 @@
 #import "C++/Kernel.hpp"
 
 // This must be done in a source file -- include files cannot see the Swift bridging file which contains the definition
-// of ParameterAddress.
+// of ParameterAddress. The engine has its own copy of the parameter addresses so that it does not depend on it.
 
 @import ParameterAddress;
 
-void Kernel::setParameterValue(AUParameterAddress address, AUValue value, AUAudioFrameCount duration) noexcept {
-  os_log_with_type(log_, OS_LOG_TYPE_DEBUG, "setParameterValue - %llul %f %d", address, value, duration);
-  assert(duration >= 0);
+static_assert(ParameterAddressDamping < Kernel::maxParameterCount, "too many parameters for Kernel");
+static_assert(ParameterAddressDamping + 1 == Chorus::parameterCount, "Chorus::Parameter mismatch");
 
-  if (duration > rampRemaining_) rampRemaining_ = duration;
-  switch (address) {
-    case ParameterAddressRate: setRate(value, duration); break;
-    case ParameterAddressDepth: depth_.set(value, duration); break;
-    case ParameterAddressDelay: delay_.set(value, duration); break;
-    case ParameterAddressDry: dryMix_.set(value, duration); break;
-    case ParameterAddressWet: wetMix_.set(value, duration); break;
-    case ParameterAddressOdd90: odd90_.set(value); break;
-  }
-}
-
-AUValue Kernel::getParameterValue(AUParameterAddress address) const noexcept {
-  switch (address) {
-    case ParameterAddressRate: return rate_.get();
-    case ParameterAddressDepth: return depth_.get();
-    case ParameterAddressDelay: return delay_.get();
-    case ParameterAddressDry: return dryMix_.get();
-    case ParameterAddressWet: return wetMix_.get();
-    case ParameterAddressOdd90: return odd90_.get();
-  }
-  return 0.0;
-}
+static_assert(ParameterAddressRate == AUParameterAddress(Chorus::Parameter::rate), "Chorus::Parameter mismatch");
+static_assert(ParameterAddressDelay == AUParameterAddress(Chorus::Parameter::delay), "Chorus::Parameter mismatch");
+static_assert(ParameterAddressDepth == AUParameterAddress(Chorus::Parameter::depth), "Chorus::Parameter mismatch");
+static_assert(ParameterAddressDry == AUParameterAddress(Chorus::Parameter::dry), "Chorus::Parameter mismatch");
+static_assert(ParameterAddressWet == AUParameterAddress(Chorus::Parameter::wet), "Chorus::Parameter mismatch");
+static_assert(ParameterAddressOdd90 == AUParameterAddress(Chorus::Parameter::odd90), "Chorus::Parameter mismatch");
+static_assert(ParameterAddressQuality == AUParameterAddress(Chorus::Parameter::quality),
+              "Chorus::Parameter mismatch");
+static_assert(ParameterAddressVoices == AUParameterAddress(Chorus::Parameter::voices),
+              "Chorus::Parameter mismatch");
+static_assert(ParameterAddressFeedback == AUParameterAddress(Chorus::Parameter::feedback),
+              "Chorus::Parameter mismatch");
+static_assert(ParameterAddressDamping == AUParameterAddress(Chorus::Parameter::damping),
+              "Chorus::Parameter mismatch");
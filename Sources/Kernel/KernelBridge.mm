@@ -8,16 +8,47 @@
 @implementation KernelBridge {
   Kernel* kernel_;
   AUValue maxDelayMilliseconds_;
+  dispatch_source_t traceFlushTimer_;
 }
 
+static constexpr NSInteger defaultMaxChannelCount = 8;
+static constexpr double defaultMaxSampleRate = 96000.0;
+static constexpr AUAudioFrameCount reservedFramesToRender = 4096;
+
 - (instancetype)init:(NSString*)appExtensionName maxDelayMilliseconds:(AUValue)maxDelayMilliseconds {
+  return [self init:appExtensionName maxDelayMilliseconds:maxDelayMilliseconds maxChannelCount:defaultMaxChannelCount
+      maxSampleRate:defaultMaxSampleRate];
+}
+
+- (instancetype)init:(NSString*)appExtensionName maxDelayMilliseconds:(AUValue)maxDelayMilliseconds
+     maxChannelCount:(NSInteger)maxChannelCount maxSampleRate:(double)maxSampleRate {
   if (self = [super init]) {
     self->kernel_ = new Kernel(std::string(appExtensionName.UTF8String));
+    self->kernel_->reserve(int(maxChannelCount), maxSampleRate, reservedFramesToRender, maxDelayMilliseconds);
     self->maxDelayMilliseconds_ = maxDelayMilliseconds;
+    [self startTraceFlushTimer];
   }
   return self;
 }
 
+- (void)dealloc {
+  if (traceFlushTimer_ != nil) dispatch_source_cancel(traceFlushTimer_);
+}
+
+- (void)startTraceFlushTimer {
+  // Periodically move the trace events recorded by the render thread into the log.
+  auto queue = dispatch_get_global_queue(QOS_CLASS_UTILITY, 0);
+  traceFlushTimer_ = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, queue);
+  dispatch_source_set_timer(traceFlushTimer_, dispatch_time(DISPATCH_TIME_NOW, 0), 250 * NSEC_PER_MSEC,
+                            50 * NSEC_PER_MSEC);
+  __weak KernelBridge* weakSelf = self;
+  dispatch_source_set_event_handler(traceFlushTimer_, ^{
+    KernelBridge* strongSelf = weakSelf;
+    if (strongSelf != nil) strongSelf->kernel_->flushTrace();
+  });
+  dispatch_resume(traceFlushTimer_);
+}
+
 - (void)setRenderingFormat:(NSInteger)busCount format:(AVAudioFormat*)inputFormat
          maxFramesToRender:(AUAudioFrameCount)maxFramesToRender {
   kernel_->setRenderingFormat(busCount, inputFormat, maxFramesToRender, maxDelayMilliseconds_);
@@ -27,18 +58,65 @@
 
 - (AUInternalRenderBlock)internalRenderBlock {
   auto& kernel = *kernel_;
-  NSInteger bus = 0;
   return ^AUAudioUnitStatus(AudioUnitRenderActionFlags* flags, const AudioTimeStamp* timestamp,
-                            AUAudioFrameCount frameCount, NSInteger, AudioBufferList* output,
+                            AUAudioFrameCount frameCount, NSInteger outputBusNumber, AudioBufferList* output,
                             const AURenderEvent* realtimeEventListHead, AURenderPullInputBlock pullInputBlock) {
-    return kernel.processAndRender(timestamp, frameCount, bus, output, realtimeEventListHead, pullInputBlock);
+    return kernel.processAndRender(timestamp, frameCount, outputBusNumber, output, realtimeEventListHead,
+                                   pullInputBlock, flags);
   };
 }
 
 - (void)setBypass:(BOOL)state { kernel_->setBypass(state); }
 
-- (void)set:(AUParameter *)parameter value:(AUValue)value { kernel_->setParameterValue(parameter.address, value, 0.0); }
+- (double)tailTime { return kernel_->tailTime(); }
+
+- (void)setInstrumentationEnabled:(BOOL)enabled { kernel_->setInstrumentationEnabled(enabled); }
+
+- (KernelRenderStatistics)renderStatistics {
+  constexpr double microsPerNano = 1.0E-3;
+  auto snapshot = kernel_->renderStatistics().snapshot();
+  KernelRenderStatistics stats;
+  stats.renderCount = snapshot.renderCount;
+  stats.frameCount = snapshot.frameCount;
+  stats.minRenderTime = snapshot.minDuration * microsPerNano;
+  stats.averageRenderTime = snapshot.averageDuration * microsPerNano;
+  stats.maxRenderTime = snapshot.maxDuration * microsPerNano;
+  stats.p99RenderTime = snapshot.p99Duration * microsPerNano;
+  stats.load = snapshot.load;
+  stats.rampRenderCount = snapshot.rampRenderCount;
+  stats.rampFrameCount = snapshot.rampFrameCount;
+  stats.deadlineOverrunCount = snapshot.deadlineOverrunCount;
+  return stats;
+}
+
+- (void)resetRenderStatistics { kernel_->resetRenderStatistics(); }
+
+- (void)setCompactDelayLines:(BOOL)enabled { kernel_->setCompactDelayLines(enabled); }
+
+- (void)setDenormalBias:(BOOL)enabled { kernel_->setDenormalBias(enabled); }
+
+- (void)setRenderWorkerCount:(NSInteger)workerCount minChannelCount:(NSInteger)minChannelCount {
+  kernel_->setRenderWorkers(size_t(std::max<NSInteger>(workerCount, 0)),
+                            size_t(std::max<NSInteger>(minChannelCount, 0)));
+}
+
+- (void)setRenderWorkerCount:(NSInteger)workerCount minChannelCount:(NSInteger)minChannelCount
+                   workgroup:(os_workgroup_t)workgroup {
+  kernel_->setRenderWorkers(size_t(std::max<NSInteger>(workerCount, 0)),
+                            size_t(std::max<NSInteger>(minChannelCount, 0)), workgroup);
+}
+
+- (void)setPreset:(KernelPreset)preset crossfadeFrames:(AUAudioFrameCount)crossfadeFrames {
+  kernel_->postPreset({preset.rate, preset.delay, preset.depth, preset.dry, preset.wet, preset.odd90, preset.quality,
+    preset.voices, preset.feedback, preset.damping, crossfadeFrames});
+}
+
+- (void)set:(AUParameter *)parameter value:(AUValue)value {
+  // A value that the kernel already has -- such as one from a preset given to `setPreset` -- is not posted again.
+  if (kernel_->getPostedParameterValue(parameter.address) == value) return;
+  kernel_->postParameterValue(parameter.address, value);
+}
 
-- (AUValue)get:(AUParameter *)parameter { return kernel_->getParameterValue(parameter.address); }
+- (AUValue)get:(AUParameter *)parameter { return kernel_->getPostedParameterValue(parameter.address); }
 
 @end
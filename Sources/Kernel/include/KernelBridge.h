@@ -3,17 +3,77 @@
 #pragma once
 
 #import <AudioToolbox/AudioToolbox.h>
+#import <os/workgroup.h>
 
 NS_ASSUME_NONNULL_BEGIN
 
+/**
+ Snapshot of the render statistics recorded by the kernel while instrumentation is enabled. Times are in microseconds.
+ */
+typedef struct {
+  /// Number of render calls
+  uint64_t renderCount;
+  /// Number of frames rendered
+  uint64_t frameCount;
+  double minRenderTime;
+  double averageRenderTime;
+  double maxRenderTime;
+  /// Estimate of the render time that 99% of render calls were under
+  double p99RenderTime;
+  /// Fraction of the available render time that was used, where 1.0 means rendering took as long as the audio lasts
+  double load;
+  /// Number of render segments that had ramping parameters
+  uint64_t rampRenderCount;
+  /// Number of frames rendered with ramping parameters
+  uint64_t rampFrameCount;
+  /// Number of render calls that took longer than the duration of the audio they rendered
+  uint64_t deadlineOverrunCount;
+} KernelRenderStatistics;
+
+/**
+ Complete set of parameter values for the kernel to apply in one step. The values use the same units as the runtime
+ parameters.
+ */
+typedef struct {
+  AUValue rate;
+  AUValue delay;
+  AUValue depth;
+  AUValue dry;
+  AUValue wet;
+  AUValue odd90;
+  AUValue quality;
+  AUValue voices;
+  AUValue feedback;
+  AUValue damping;
+} KernelPreset;
+
 /**
  Small Obj-C bridge between Swift and the C++ kernel classes. The `Bridge` package contains the actual adoption of the
  `AUParameterHandler` and `AudioRenderer` protocols.
  */
 @interface KernelBridge : NSObject
 
+/**
+ Create a new kernel that is prepared to render up to 8 channels at sample rates up to 96 kHz without allocating
+ memory when the rendering format changes.
+
+ @param appExtensionName the name to use for logging
+ @param maxDelayMilliseconds the max delay time in milliseconds
+ */
 - (nonnull id)init:(NSString*)appExtensionName maxDelayMilliseconds:(AUValue)maxDelayMilliseconds;
 
+/**
+ Create a new kernel with delay lines and work buffers preallocated for the given limits. A rendering format that fits
+ within them only rebinds the existing storage. Larger formats are still supported but allocate when they are set.
+
+ @param appExtensionName the name to use for logging
+ @param maxDelayMilliseconds the max delay time in milliseconds
+ @param maxChannelCount the max number of channels that will be rendered
+ @param maxSampleRate the max sample rate that will be rendered
+ */
+- (nonnull id)init:(NSString*)appExtensionName maxDelayMilliseconds:(AUValue)maxDelayMilliseconds
+   maxChannelCount:(NSInteger)maxChannelCount maxSampleRate:(double)maxSampleRate;
+
 @end
 
 // These are the functions that satisfy the AudioRenderer protocol
@@ -22,7 +82,8 @@ NS_ASSUME_NONNULL_BEGIN
 /**
  Configure the kernel for new format and max frame in preparation to begin rendering
 
- @param busCount number of busses that the kernel must support
+ @param busCount number of busses that the kernel must support. Every bus has the same format and its own delay lines,
+ but all busses share the LFO and parameter settings.
  @param inputFormat the current format of the input bus
  @param maxFramesToRender the max frames to expect in a render request
  @param maxDelayMilliseconds the max delay time in milliseconds
@@ -43,12 +104,106 @@ NS_ASSUME_NONNULL_BEGIN
 - (AUInternalRenderBlock)internalRenderBlock;
 
 /**
- Set the bypass state.
+ Set the bypass state. The delay lines drain before the effect stops rendering, and they are cleared when the
+ bypass ends.
 
  @param state new bypass value
  */
 - (void)setBypass:(BOOL)state;
 
+/**
+ Obtain the time it takes for the output to settle after the input becomes silent. When the effect is bypassed, the
+ audio already taken in plays out over this time before the input is passed through unchanged.
+
+ @returns tail time in seconds
+ */
+- (double)tailTime;
+
+@end
+
+@interface KernelBridge (Instrumentation)
+
+/**
+ Turn on or off the recording of render statistics. Recording is off by default and costs two clock reads per render
+ call when on.
+
+ @param enabled true to record statistics
+ */
+- (void)setInstrumentationEnabled:(BOOL)enabled;
+
+/**
+ Obtain the render statistics recorded so far. Safe to call from any thread while rendering.
+
+ @returns snapshot of the statistics
+ */
+- (KernelRenderStatistics)renderStatistics;
+
+/**
+ Clear the render statistics.
+ */
+- (void)resetRenderStatistics;
+
+@end
+
+@interface KernelBridge (Storage)
+
+/**
+ Choose whether the delay lines hold 16-bit samples instead of 32-bit floats. This halves their memory footprint at
+ the cost of a little noise in the wet signal. Takes effect with the next `setRenderingFormat` call. Delay lines for
+ both kinds of samples are reserved when the bridge is created, so the change does not allocate.
+
+ @param enabled true to use compact samples
+ */
+- (void)setCompactDelayLines:(BOOL)enabled;
+
+/**
+ Choose whether an inaudible DC offset is added to the samples written to the delay lines, which keeps them out of the
+ denormal range. Must not be changed while rendering.
+
+ @param enabled true to add the offset
+ */
+- (void)setDenormalBias:(BOOL)enabled;
+
+@end
+
+@interface KernelBridge (Parallel)
+
+/**
+ Start worker threads that render groups of channels alongside the render thread for formats with many channels. Must
+ not be called while rendering.
+
+ @param workerCount the number of worker threads. Use 0 to render all channels on the render thread.
+ @param minChannelCount the smallest channel count that is rendered in parallel
+ */
+- (void)setRenderWorkerCount:(NSInteger)workerCount minChannelCount:(NSInteger)minChannelCount;
+
+/**
+ Start worker threads that render groups of channels alongside the render thread, with the threads joining the given
+ audio workgroup so that the OS schedules them together with the render thread. Must not be called while rendering.
+
+ @param workerCount the number of worker threads. Use 0 to render all channels on the render thread.
+ @param minChannelCount the smallest channel count that is rendered in parallel
+ @param workgroup the workgroup of the render thread, such as the one from `AUAudioUnit.osWorkgroup`
+ */
+- (void)setRenderWorkerCount:(NSInteger)workerCount minChannelCount:(NSInteger)minChannelCount
+                   workgroup:(nullable os_workgroup_t)workgroup API_AVAILABLE(macos(11.0), ios(14.0));
+
+@end
+
+@interface KernelBridge (Presets)
+
+/**
+ Hand a complete preset to the kernel. The preset is published with one atomic pointer swap and the render thread
+ applies all of its values at the start of the next render call, optionally crossfading to them. Must only be called
+ from one thread. The AUParameter values are not changed, but until the render thread switches to the preset `get:`
+ returns its values and `set:value:` does not post a value that matches, so setting the AUParameters to the preset
+ values afterwards leaves the preset and its crossfade alone.
+
+ @param preset the values to apply
+ @param crossfadeFrames the number of frames to crossfade over, or 0 to switch at once
+ */
+- (void)setPreset:(KernelPreset)preset crossfadeFrames:(AUAudioFrameCount)crossfadeFrames;
+
 @end
 
 // These are the functions that satisfy the AUParameterHandler protocol
@@ -21,6 +21,17 @@ import AUv3Support
   case wet
   /// When true, "odd" audio channels (eg. right in stereo) are shifted 90° in phase from the even channels.
   case odd90
+  /// The interpolation method used when reading from the delay lines: 0 = none, 1 = linear, 2 = cubic, 3 = allpass.
+  /// Lower values cost less CPU.
+  case quality
+  /// The number of delayed copies of the input signal to mix together. Each one has its own LFO phase and rate.
+  case voices
+  /// Percentage of the delayed signal to feed back into the delay lines. Negative values invert the signal that is fed
+  /// back.
+  case feedback
+  /// Percentage of high-frequency loss applied to the signal that is fed back. Each trip around the feedback loop
+  /// sounds darker than the last.
+  case damping
 };
 
 public extension ParameterAddress {
@@ -37,6 +48,14 @@ public extension ParameterAddress {
     case .dry: return .defPercent("dry", localized: "Dry", address: ParameterAddress.dry)
     case .wet: return .defPercent("wet", localized: "Wet", address: ParameterAddress.wet)
     case .odd90: return .defBool("odd90", localized: "Odd 90°", address: ParameterAddress.odd90)
+    case .quality: return .defFloat("quality", localized: "Quality", address: ParameterAddress.quality,
+                                    range: 0.0...3.0, unit: .indexed, ramping: false)
+    case .voices: return .defFloat("voices", localized: "Voices", address: ParameterAddress.voices,
+                                   range: 1.0...8.0, unit: .indexed, ramping: false)
+    case .feedback: return .defFloat("feedback", localized: "Feedback", address: ParameterAddress.feedback,
+                                     range: -95.0...95.0, unit: .percent)
+    case .damping: return .defFloat("damping", localized: "Damping", address: ParameterAddress.damping,
+                                    range: 0.0...100.0, unit: .percent, ramping: false)
     }
   }
 }
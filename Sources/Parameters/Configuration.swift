@@ -1,6 +1,7 @@
 // Copyright © 2021 Brad Howes. All rights reserved.
 
 import AudioToolbox
+import Kernel
 
 /**
  Collection of values for the parameters of the audio unit. Treated as a unit that can be named and recalled using the
@@ -13,6 +14,10 @@ public struct Configuration {
   public let dry: AUValue
   public let wet: AUValue
   public let odd90: AUValue
+  public let quality: AUValue
+  public let voices: AUValue
+  public let feedback: AUValue
+  public let damping: AUValue
 
   /**
    Define a new configuration.
@@ -23,13 +28,31 @@ public struct Configuration {
    - parameter dry: the dry (original audio) mix setting
    - parameter wet: the wet (effect audio) mix setting
    - parameter odd90: the odd 90° setting
+   - parameter quality: the delay line interpolation setting (default is cubic)
+   - parameter voices: the number of chorus voices (default is 1)
+   - parameter feedback: the feedback setting (default is 0)
+   - parameter damping: the damping of the feedback (default is 0)
    */
-  public init(rate: AUValue, delay: AUValue, depth: AUValue, dry: AUValue, wet: AUValue, odd90: AUValue) {
+  public init(rate: AUValue, delay: AUValue, depth: AUValue, dry: AUValue, wet: AUValue, odd90: AUValue,
+              quality: AUValue = 2.0, voices: AUValue = 1.0, feedback: AUValue = 0.0, damping: AUValue = 0.0) {
     self.rate = rate
     self.delay = delay
     self.depth = depth
     self.dry = dry
     self.wet = wet
     self.odd90 = odd90
+    self.quality = quality
+    self.voices = voices
+    self.feedback = feedback
+    self.damping = damping
+  }
+}
+
+extension Configuration {
+
+  /// The configuration as a snapshot that the kernel can apply in one step (see `KernelBridge.setPreset`).
+  public var kernelPreset: KernelPreset {
+    .init(rate: rate, delay: delay, depth: depth, dry: dry, wet: wet, odd90: odd90, quality: quality, voices: voices,
+          feedback: feedback, damping: damping)
   }
 }
@@ -3,6 +3,7 @@
 import AUv3Support
 import CoreAudioKit
 import Foundation
+import Kernel
 import ParameterAddress
 import os.log
 
@@ -28,6 +29,8 @@ public final class Parameters: NSObject, ParameterSource {
     ("Wavy Pong", .init(rate: 5.1, delay: 8.3, depth: 100, dry: 50, wet: 100, odd90: 1)),
     ("Shimmer", .init(rate: 10.0, delay: 1.75, depth: 1.4, dry: 50, wet: 100, odd90: 1)),
     ("Disturbed", .init(rate: 5.0, delay: 50.0, depth: 100.0, dry: 50, wet: 100, odd90: 1)),
+    ("Ensemble", .init(rate: 0.8, delay: 12.0, depth: 60.0, dry: 50, wet: 100, odd90: 1, voices: 4)),
+    ("Jet", .init(rate: 0.2, delay: 3.0, depth: 90.0, dry: 50, wet: 50, odd90: 0, feedback: 70, damping: 30)),
   ]
 
   /// Array of `AUAudioUnitPreset` for the factory presets.
@@ -37,6 +40,9 @@ public final class Parameters: NSObject, ParameterSource {
 
   /// AUParameterTree created with the parameter definitions for the audio unit
   public let parameterTree: AUParameterTree
+  /// The kernel that renders with these parameters. When set, presets are handed to it as one snapshot instead of one
+  /// parameter change at a time.
+  public weak var kernel: KernelBridge?
   /// Obtain the parameter setting that determines how fast the LFO operates
   public var rate: AUParameter { parameters[.rate] }
   /// Obtain the parameter setting that determines the minimum delay applied incoming samples. The actual delay value is
@@ -51,6 +57,14 @@ public final class Parameters: NSObject, ParameterSource {
   public var wetMix: AUParameter { parameters[.wet] }
   /// Obtain the `odd90` parameter setting
   public var odd90: AUParameter { parameters[.odd90] }
+  /// Obtain the `quality` parameter setting
+  public var quality: AUParameter { parameters[.quality] }
+  /// Obtain the `voices` parameter setting
+  public var voices: AUParameter { parameters[.voices] }
+  /// Obtain the `feedback` parameter setting
+  public var feedback: AUParameter { parameters[.feedback] }
+  /// Obtain the `damping` parameter setting
+  public var damping: AUParameter { parameters[.damping] }
 
   /**
    Create a new AUParameterTree for the defined filter parameters.
@@ -66,12 +80,17 @@ extension Parameters {
 
   private var missingParameter: AUParameter { fatalError() }
 
-  /// Apply a factory preset -- user preset changes are handled by changing AUParameter values through the audio unit's
-  /// `fullState` attribute.
-  public func useFactoryPreset(_ preset: AUAudioUnitPreset) {
+  /**
+   Apply a factory preset -- user preset changes are handled by changing AUParameter values through the audio unit's
+   `fullState` attribute.
+
+   - parameter preset: the factory preset to apply
+   - parameter crossfadeFrames: the number of frames over which the kernel crossfades to the preset (default is 0)
+   */
+  public func useFactoryPreset(_ preset: AUAudioUnitPreset, crossfadeFrames: AUAudioFrameCount = 0) {
     os_log(.info, log: log, "useFactoryPreset - %d '%{public}s'", preset.number, preset.name)
     if preset.number >= 0 {
-      setValues(factoryPresetValues[preset.number].preset)
+      setValues(factoryPresetValues[preset.number].preset, crossfadeFrames: crossfadeFrames)
     }
   }
 
@@ -106,16 +125,26 @@ extension Parameters {
   }
 
   /**
-   Accept new values for the filter settings. Uses the AUParameterTree framework for communicating the changes to the
-   AudioUnit.
+   Accept new values for the filter settings. With a `kernel`, the values go to it as one preset, and the AUParameter
+   values are then updated to match so that the host sees them. The kernel bridge does not post values that the
+   kernel already has, so these updates do not undo the preset or its crossfade. Without a `kernel`, the changes are
+   communicated to the AudioUnit one at a time through the AUParameterTree framework.
+
+   - parameter preset: the values to use
+   - parameter crossfadeFrames: the number of frames over which the kernel crossfades to the values (default is 0)
    */
-  public func setValues(_ preset: Configuration) {
+  public func setValues(_ preset: Configuration, crossfadeFrames: AUAudioFrameCount = 0) {
+    kernel?.setPreset(preset.kernelPreset, crossfadeFrames: crossfadeFrames)
     rate.value = preset.rate
     delay.value = preset.delay
     depth.value = preset.depth
     dryMix.value = preset.dry
     wetMix.value = preset.wet
     odd90.value = preset.odd90
+    quality.value = preset.quality
+    voices.value = preset.voices
+    feedback.value = preset.feedback
+    damping.value = preset.damping
   }
 }
 
@@ -135,7 +164,7 @@ extension AUParameter {
   /// Obtain the format to use in String(format:value) when formatting a values
   var stringFormatForValue: String {
     switch parameterAddress {
-    case .depth, .dry, .wet: return "%.0f"
+    case .depth, .dry, .wet, .quality, .voices, .feedback, .damping: return "%.0f"
     default: return "%.2f"
     }
   }
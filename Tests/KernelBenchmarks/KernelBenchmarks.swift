@@ -0,0 +1,239 @@
+// Copyright © 2022 Brad Howes. All rights reserved.
+
+import AVFoundation
+import XCTest
+import Kernel
+import ParameterAddress
+import Parameters
+
+/**
+ Drives the kernel through the same render block that the audio unit uses, with synthetic input. When `ramping` is true
+ every render call carries a parameter ramp event that spans the whole block.
+ */
+final class RenderHarness {
+  let bridge: KernelBridge
+  let parameters = Parameters()
+  let format: AVAudioFormat
+  let blockSize: AUAudioFrameCount
+  var ramping = false
+
+  private let input: AVAudioPCMBuffer
+  private let output: AVAudioPCMBuffer
+  private let renderBlock: AUInternalRenderBlock
+  private let pullInputBlock: AURenderPullInputBlock
+  private var sampleTime: Float64 = 0.0
+  private var rampEvent = AURenderEvent()
+  private var rampUp = true
+
+  init(channels: AVAudioChannelCount, sampleRate: Double, blockSize: AUAudioFrameCount) {
+    self.bridge = KernelBridge("KernelBenchmarks", maxDelayMilliseconds: 50.0)
+    self.format = AVAudioFormat(standardFormatWithSampleRate: sampleRate, channels: channels)!
+    self.blockSize = blockSize
+    self.input = AVAudioPCMBuffer(pcmFormat: format, frameCapacity: blockSize)!
+    self.output = AVAudioPCMBuffer(pcmFormat: format, frameCapacity: blockSize)!
+    input.frameLength = blockSize
+    output.frameLength = blockSize
+
+    var seed: UInt32 = 12345
+    for channel in 0..<Int(channels) {
+      let samples = input.floatChannelData![channel]
+      for frame in 0..<Int(blockSize) {
+        seed = seed &* 1664525 &+ 1013904223
+        samples[frame] = Float(seed >> 8) / Float(1 << 24) * 2.0 - 1.0
+      }
+    }
+
+    let inputBuffers = UnsafeMutableAudioBufferListPointer(input.mutableAudioBufferList)
+    self.pullInputBlock = { _, _, frameCount, _, bufferList in
+      let buffers = UnsafeMutableAudioBufferListPointer(bufferList)
+      let byteCount = Int(frameCount) * MemoryLayout<AUValue>.size
+      for index in 0..<min(buffers.count, inputBuffers.count) {
+        if let destination = buffers[index].mData {
+          memcpy(destination, inputBuffers[index].mData!, byteCount)
+        } else {
+          buffers[index].mData = inputBuffers[index].mData
+        }
+        buffers[index].mDataByteSize = UInt32(byteCount)
+      }
+      return noErr
+    }
+
+    bridge.setRenderingFormat(1, format: format, maxFramesToRender: 4096)
+    self.renderBlock = bridge.internalRenderBlock()
+  }
+
+  /**
+   Apply a preset directly to the kernel.
+
+   - parameter configuration: the parameter values to use
+   */
+  func apply(_ configuration: Configuration) {
+    post(configuration)
+    render()
+  }
+
+  /**
+   Post the values of a preset to the kernel. They are applied at the start of the next render call.
+
+   - parameter configuration: the parameter values to use
+   */
+  func post(_ configuration: Configuration) {
+    bridge.set(parameters[.rate], value: configuration.rate)
+    bridge.set(parameters[.delay], value: configuration.delay)
+    bridge.set(parameters[.depth], value: configuration.depth)
+    bridge.set(parameters[.dry], value: configuration.dry)
+    bridge.set(parameters[.wet], value: configuration.wet)
+    bridge.set(parameters[.odd90], value: configuration.odd90)
+    bridge.set(parameters[.quality], value: configuration.quality)
+    bridge.set(parameters[.voices], value: configuration.voices)
+    bridge.set(parameters[.feedback], value: configuration.feedback)
+    bridge.set(parameters[.damping], value: configuration.damping)
+  }
+
+  /// Render one block of samples
+  func render() {
+    var flags = AudioUnitRenderActionFlags()
+    var timestamp = AudioTimeStamp()
+    timestamp.mSampleTime = sampleTime
+    timestamp.mFlags = .sampleTimeValid
+    sampleTime += Float64(blockSize)
+
+    let status: AUAudioUnitStatus
+    if ramping {
+      // Sweep the delay back and forth so that the tap position, displacement and LFO all ramp.
+      rampUp.toggle()
+      rampEvent.parameter = AUParameterEvent(next: nil, eventSampleTime: AUEventSampleTime(timestamp.mSampleTime),
+                                             eventType: .parameterRamp, reserved: (0, 0, 0),
+                                             rampDurationSampleFrames: blockSize,
+                                             parameterAddress: ParameterAddress.delay.rawValue,
+                                             value: rampUp ? 12.0 : 6.0)
+      status = withUnsafePointer(to: &rampEvent) {
+        renderBlock(&flags, &timestamp, blockSize, 0, output.mutableAudioBufferList, $0, pullInputBlock)
+      }
+    } else {
+      status = renderBlock(&flags, &timestamp, blockSize, 0, output.mutableAudioBufferList, nil, pullInputBlock)
+    }
+    precondition(status == noErr)
+  }
+
+  /**
+   Render the given samples instead of the synthetic input.
+
+   - parameter samples: one array of samples per channel. The sample count must be a multiple of the block size.
+   - returns: the rendered samples, one array per channel
+   */
+  func process(_ samples: [[AUValue]]) -> [[AUValue]] {
+    precondition(samples.count == Int(format.channelCount))
+    let frameCount = samples[0].count
+    precondition(frameCount % Int(blockSize) == 0)
+    var rendered = samples.map { [AUValue](repeating: 0.0, count: $0.count) }
+    for position in stride(from: 0, to: frameCount, by: Int(blockSize)) {
+      for channel in 0..<samples.count {
+        samples[channel].withUnsafeBufferPointer {
+          input.floatChannelData![channel].assign(from: $0.baseAddress! + position, count: Int(blockSize))
+        }
+      }
+      render()
+      for channel in 0..<samples.count {
+        rendered[channel].withUnsafeMutableBufferPointer {
+          ($0.baseAddress! + position).assign(from: output.floatChannelData![channel], count: Int(blockSize))
+        }
+      }
+    }
+    return rendered
+  }
+
+  /**
+   Render the given duration of audio.
+
+   - parameter seconds: the amount of audio to render
+   - returns: number of frames rendered
+   */
+  @discardableResult
+  func render(seconds: Double) -> Int {
+    let blocks = max(Int(seconds * format.sampleRate) / Int(blockSize), 1)
+    for _ in 0..<blocks {
+      render()
+    }
+    return blocks * Int(blockSize)
+  }
+
+  /**
+   Time the rendering of the given duration of audio.
+
+   - parameter seconds: the amount of audio to render
+   - returns: 2-tuple of nanoseconds per channel sample and the ratio of audio time to render time
+   */
+  func time(seconds: Double) -> (nanosPerSample: Double, realtimeFactor: Double) {
+    render(seconds: 0.05)
+    let start = DispatchTime.now().uptimeNanoseconds
+    let frames = render(seconds: seconds)
+    let elapsed = Double(DispatchTime.now().uptimeNanoseconds - start)
+    let audioNanos = Double(frames) / format.sampleRate * 1.0e9
+    return (elapsed / Double(frames * Int(format.channelCount)), audioNanos / elapsed)
+  }
+}
+
+final class KernelBenchmarks: XCTestCase {
+
+  private let defaultPreset = Parameters().factoryPresetValues[0].preset
+
+  func testSteadyStereo48k() throws {
+    let harness = RenderHarness(channels: 2, sampleRate: 48000.0, blockSize: 512)
+    harness.apply(defaultPreset)
+    measure { harness.render(seconds: 1.0) }
+  }
+
+  func testRampingStereo48k() throws {
+    let harness = RenderHarness(channels: 2, sampleRate: 48000.0, blockSize: 512)
+    harness.apply(defaultPreset)
+    harness.ramping = true
+    measure { harness.render(seconds: 1.0) }
+  }
+
+  func testSteadyOctal96k() throws {
+    let harness = RenderHarness(channels: 8, sampleRate: 96000.0, blockSize: 512)
+    harness.apply(defaultPreset)
+    measure { harness.render(seconds: 1.0) }
+  }
+
+  func testFactoryPresets() throws {
+    let harness = RenderHarness(channels: 2, sampleRate: 48000.0, blockSize: 512)
+    let presets = harness.parameters.factoryPresetValues
+    for (name, preset) in presets {
+      harness.apply(preset)
+      let result = harness.time(seconds: 1.0)
+      print(String(format: "preset %-12@ %8.2f ns/sample %8.1fx realtime", name, result.nanosPerSample,
+                   result.realtimeFactor))
+    }
+
+    measure {
+      for (_, preset) in presets {
+        harness.apply(preset)
+        harness.render(seconds: 0.25)
+      }
+    }
+  }
+
+  /// Full sweep of channel counts, sample rates, block sizes and ramping. This takes a while, so it only runs when the
+  /// KERNEL_BENCHMARK_SWEEP environment variable is set.
+  func testSweep() throws {
+    try XCTSkipIf(ProcessInfo.processInfo.environment["KERNEL_BENCHMARK_SWEEP"] == nil,
+                  "set KERNEL_BENCHMARK_SWEEP to run")
+    for channels: AVAudioChannelCount in [1, 2, 8] {
+      for sampleRate in [44100.0, 48000.0, 96000.0, 192000.0] {
+        for blockSize: AUAudioFrameCount in [16, 64, 256, 512, 1024, 4096] {
+          for ramping in [false, true] {
+            let harness = RenderHarness(channels: channels, sampleRate: sampleRate, blockSize: blockSize)
+            harness.apply(defaultPreset)
+            harness.ramping = ramping
+            let result = harness.time(seconds: 0.5)
+            print(String(format: "channels %d rate %6.0f block %4d %@ %8.2f ns/sample %8.1fx realtime", channels,
+                         sampleRate, blockSize, ramping ? "ramping" : "steady ", result.nanosPerSample,
+                         result.realtimeFactor))
+          }
+        }
+      }
+    }
+  }
+}
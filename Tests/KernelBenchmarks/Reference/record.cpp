@@ -0,0 +1,135 @@
+// Copyright © 2022 Brad Howes. All rights reserved.
+
+/**
+ Records the reference outputs that `ReferenceTests` checks the factory presets against, for hosts that cannot run the
+ tests with KERNEL_RECORD_REFERENCE set. It makes the same engine calls as `KernelBridge` and `RenderHarness` do: a
+ reserve for the bridge defaults, a stereo 48 kHz format, the preset posted through the bridge, and 512-frame render
+ calls that apply the posted values first. Build and run it from the top of the repository:
+
+   c++ -std=c++17 -O2 -I Sources/Kernel/C++ Tests/KernelBenchmarks/Reference/record.cpp -o record
+   ./record Tests/KernelBenchmarks/Reference
+
+ The presets and the test signals must match those of `Parameters` and `ReferenceTests`.
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "DenormalGuard.hpp"
+#include "Engine.hpp"
+
+namespace {
+
+/// Exposes the render calls that `BasicKernel::processAndRender` makes.
+struct Harness : Chorus::Engine<float> {
+  using Engine::applyPostedParameterValues;
+  using Engine::beginCycle;
+  using Engine::render;
+};
+
+struct Preset {
+  const char* name;
+  /// Values by parameter address: rate, delay, depth, dry, wet, odd90, quality, voices, feedback, damping
+  float values[Chorus::parameterCount];
+};
+
+constexpr Preset presets[] = {
+  {"Cadet", {1.68f, 8.3f, 100.0f, 50.0f, 100.0f, 0.0f, 2.0f, 1.0f, 0.0f, 0.0f}},
+  {"Wide Cadet", {1.68f, 8.3f, 100.0f, 50.0f, 100.0f, 1.0f, 2.0f, 1.0f, 0.0f, 0.0f}},
+  {"Wavy", {5.1f, 8.3f, 100.0f, 50.0f, 100.0f, 0.0f, 2.0f, 1.0f, 0.0f, 0.0f}},
+  {"Wavy Pong", {5.1f, 8.3f, 100.0f, 50.0f, 100.0f, 1.0f, 2.0f, 1.0f, 0.0f, 0.0f}},
+  {"Shimmer", {10.0f, 1.75f, 1.4f, 50.0f, 100.0f, 1.0f, 2.0f, 1.0f, 0.0f, 0.0f}},
+  {"Disturbed", {5.0f, 50.0f, 100.0f, 50.0f, 100.0f, 1.0f, 2.0f, 1.0f, 0.0f, 0.0f}},
+  {"Ensemble", {0.8f, 12.0f, 60.0f, 50.0f, 100.0f, 1.0f, 2.0f, 4.0f, 0.0f, 0.0f}},
+  {"Jet", {0.2f, 3.0f, 90.0f, 50.0f, 50.0f, 0.0f, 2.0f, 1.0f, 70.0f, 30.0f}},
+};
+
+constexpr double sampleRate = 48000.0;
+constexpr size_t frameCount = 4096;
+constexpr size_t blockSize = 512;
+
+/// Fill the channels with the samples of the test signal `ReferenceTests.Signal` of the same name.
+void makeSignal(const std::string& signal, std::vector<float>& left, std::vector<float>& right) {
+  left.assign(frameCount, 0.0f);
+  right.assign(frameCount, 0.0f);
+  if (signal == "impulse") {
+    left[0] = 1.0f;
+    right[0] = 1.0f;
+  } else if (signal == "sweep") {
+    double phase = 0.0;
+    for (size_t frame = 0; frame < frameCount; ++frame) {
+      left[frame] = float(0.5 * std::sin(phase));
+      right[frame] = float(0.5 * std::cos(phase));
+      auto frequency = 20.0 * std::pow(1000.0, double(frame) / double(frameCount));
+      phase += 2.0 * M_PI * frequency / sampleRate;
+    }
+  } else {
+    uint32_t seed = 12345;
+    for (size_t frame = 0; frame < frameCount; ++frame) {
+      seed = seed * 1664525u + 1013904223u;
+      left[frame] = float(seed >> 8) / float(1 << 24) * 2.0f - 1.0f;
+      seed = seed * 1664525u + 1013904223u;
+      right[frame] = float(seed >> 8) / float(1 << 24) * 2.0f - 1.0f;
+    }
+  }
+}
+
+/// Render a signal with a preset the way `RenderHarness.process` does.
+void render(const Preset& preset, std::vector<float>& left, std::vector<float>& right) {
+  Harness engine;
+  engine.reserve(8, 96000.0, 4096, 50.0);
+  engine.configure(1, 2, sampleRate, 4096, 50.0);
+
+  // The bridge only posts the values that differ from the ones already posted.
+  for (Chorus::Address address = 0; address < Chorus::parameterCount; ++address) {
+    if (engine.getPostedParameterValue(address) != preset.values[address]) {
+      engine.postParameterValue(address, preset.values[address]);
+    }
+  }
+
+  std::vector<float> inputs[2];
+  for (size_t position = 0; position < frameCount; position += blockSize) {
+    Chorus::DenormalGuard denormalGuard;
+    inputs[0].assign(left.begin() + position, left.begin() + position + blockSize);
+    inputs[1].assign(right.begin() + position, right.begin() + position + blockSize);
+    float* ins[] = {inputs[0].data(), inputs[1].data()};
+    float* outs[] = {left.data() + position, right.data() + position};
+    engine.beginCycle(double(position), 0);
+    engine.applyPostedParameterValues();
+    engine.render(Chorus::ChannelBuffers{ins, 2}, Chorus::ChannelBuffers{outs, 2}, blockSize);
+  }
+}
+
+} // end namespace
+
+int main(int argc, const char* argv[]) {
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s DIRECTORY\n", argv[0]);
+    return 1;
+  }
+
+  std::string directory{argv[1]};
+  for (const auto& preset : presets) {
+    for (std::string signal : {"impulse", "sweep", "noise"}) {
+      std::vector<float> left, right;
+      makeSignal(signal, left, right);
+      render(preset, left, right);
+
+      // Same name and layout as `ReferenceTests.write`: the left channel, then the right one.
+      std::string name;
+      for (const char* c = preset.name; *c != '\0'; ++c) if (*c != ' ') name += *c;
+      auto path = directory + "/" + name + "-" + signal + ".f32";
+      auto file = fopen(path.c_str(), "wb");
+      if (file == nullptr) {
+        perror(path.c_str());
+        return 1;
+      }
+      fwrite(left.data(), sizeof(float), frameCount, file);
+      fwrite(right.data(), sizeof(float), frameCount, file);
+      fclose(file);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,169 @@
+// Copyright © 2022 Brad Howes. All rights reserved.
+
+import AVFoundation
+import XCTest
+import Kernel
+import ParameterAddress
+import Parameters
+
+/**
+ Guards the render path against changes to the audio and to its speed. Every factory preset renders an impulse, a sine
+ sweep and noise, and the output must stay within a tolerance of the reference output that is stored in the `Reference`
+ directory next to this file. The tolerance allows for the small differences in rounding between compilers and CPUs
+ (such as fused multiply-adds), but not for a change in the interpolation, the LFO or the mix.
+
+ The render time of each preset is held to a baseline for the machine and build configuration that runs the test.
+ Setting the KERNEL_RECORD_REFERENCE environment variable writes new reference outputs and baselines instead of checking
+ them. KERNEL_TIMING_TOLERANCE sets the percentage that a preset may be slower than its baseline (default is 20). The
+ timing test is skipped on a machine without a baseline. `Reference/record.cpp` records the same reference outputs on a
+ host that cannot run the tests.
+ */
+final class ReferenceTests: XCTestCase {
+
+  private static let sampleRate = 48000.0
+  private static let frameCount = 4096
+  private static let rmsTolerance = 5.0e-4
+  private static let peakTolerance = 5.0e-3
+
+  private let referenceDirectory = URL(fileURLWithPath: #filePath).deletingLastPathComponent()
+    .appendingPathComponent("Reference")
+  private let recording = ProcessInfo.processInfo.environment["KERNEL_RECORD_REFERENCE"] != nil
+
+  /// Test signals, each with the same samples as the signal used to record the reference outputs.
+  private enum Signal: String, CaseIterable {
+    case impulse
+    case sweep
+    case noise
+
+    /// Stereo samples of the signal
+    var samples: [[AUValue]] {
+      let frameCount = ReferenceTests.frameCount
+      var left = [AUValue](repeating: 0.0, count: frameCount)
+      var right = [AUValue](repeating: 0.0, count: frameCount)
+      switch self {
+      case .impulse:
+        left[0] = 1.0
+        right[0] = 1.0
+      case .sweep:
+        // Exponential sweep from 20 Hz to 20 kHz, with the right channel 90° ahead of the left
+        var phase = 0.0
+        for frame in 0..<frameCount {
+          left[frame] = AUValue(0.5 * sin(phase))
+          right[frame] = AUValue(0.5 * cos(phase))
+          let frequency = 20.0 * pow(1000.0, Double(frame) / Double(frameCount))
+          phase += 2.0 * Double.pi * frequency / ReferenceTests.sampleRate
+        }
+      case .noise:
+        var seed: UInt32 = 12345
+        for frame in 0..<frameCount {
+          seed = seed &* 1664525 &+ 1013904223
+          left[frame] = Float(seed >> 8) / Float(1 << 24) * 2.0 - 1.0
+          seed = seed &* 1664525 &+ 1013904223
+          right[frame] = Float(seed >> 8) / Float(1 << 24) * 2.0 - 1.0
+        }
+      }
+      return [left, right]
+    }
+  }
+
+  func testFactoryPresetOutputs() throws {
+    for (name, preset) in Parameters().factoryPresetValues {
+      for signal in Signal.allCases {
+        let harness = RenderHarness(channels: 2, sampleRate: Self.sampleRate, blockSize: 512)
+        harness.post(preset)
+        let rendered = harness.process(signal.samples)
+        let url = referenceDirectory.appendingPathComponent(
+          "\(name.replacingOccurrences(of: " ", with: ""))-\(signal.rawValue).f32")
+
+        if recording {
+          try write(rendered, to: url)
+          continue
+        }
+
+        guard FileManager.default.fileExists(atPath: url.path) else {
+          XCTFail("no reference output for \(name) \(signal) -- set KERNEL_RECORD_REFERENCE to record one")
+          continue
+        }
+
+        let reference = try read(from: url)
+        XCTAssertEqual(reference.count, rendered.count * Self.frameCount, "\(name) \(signal)")
+        guard reference.count == rendered.count * Self.frameCount else { continue }
+
+        var sumSquares = 0.0
+        var peak = 0.0
+        for (index, sample) in rendered.joined().enumerated() {
+          let difference = Double(sample) - Double(reference[index])
+          sumSquares += difference * difference
+          peak = max(peak, abs(difference))
+        }
+
+        let rms = (sumSquares / Double(reference.count)).squareRoot()
+        XCTAssertLessThanOrEqual(rms, Self.rmsTolerance, "\(name) \(signal) RMS difference")
+        XCTAssertLessThanOrEqual(peak, Self.peakTolerance, "\(name) \(signal) peak difference")
+      }
+    }
+  }
+
+  func testFactoryPresetTiming() throws {
+    let url = referenceDirectory.appendingPathComponent("Timing-\(machineName).json")
+    let baselines: [String: Double]? = recording
+      ? [:] : try? JSONDecoder().decode([String: Double].self, from: Data(contentsOf: url))
+    try XCTSkipIf(!recording && baselines == nil,
+                  "no timing baseline for \(machineName) -- set KERNEL_RECORD_REFERENCE to record one")
+
+    let tolerance = ProcessInfo.processInfo.environment["KERNEL_TIMING_TOLERANCE"].flatMap(Double.init) ?? 20.0
+    let harness = RenderHarness(channels: 2, sampleRate: Self.sampleRate, blockSize: 512)
+    var timings = [String: Double]()
+    for (name, preset) in Parameters().factoryPresetValues {
+      harness.apply(preset)
+      // The best of several runs is the least disturbed by whatever else the machine is doing.
+      let nanosPerSample = (0..<5).map { _ in harness.time(seconds: 0.25).nanosPerSample }.min()!
+      timings[name] = nanosPerSample
+      guard let baseline = baselines?[name] else { continue }
+      print(String(format: "preset %-12@ %8.2f ns/sample baseline %8.2f", name, nanosPerSample, baseline))
+      XCTAssertLessThanOrEqual(nanosPerSample, baseline * (1.0 + tolerance / 100.0),
+                               "\(name) is more than \(tolerance)% slower than its baseline")
+    }
+
+    if recording {
+      let encoder = JSONEncoder()
+      encoder.outputFormatting = [.prettyPrinted, .sortedKeys]
+      try FileManager.default.createDirectory(at: referenceDirectory, withIntermediateDirectories: true)
+      try encoder.encode(timings).write(to: url)
+    }
+  }
+}
+
+private extension ReferenceTests {
+
+  /// Name of the machine model, CPU architecture and build configuration, which together set the timing baseline.
+  var machineName: String {
+    var size = 0
+    sysctlbyname("hw.model", nil, &size, nil, 0)
+    var model = [CChar](repeating: 0, count: max(size, 1))
+    sysctlbyname("hw.model", &model, &size, nil, 0)
+#if arch(arm64)
+    let arch = "arm64"
+#else
+    let arch = "x86_64"
+#endif
+#if DEBUG
+    let configuration = "debug"
+#else
+    let configuration = "release"
+#endif
+    return "\(String(cString: model))-\(arch)-\(configuration)"
+  }
+
+  /// Write the samples of all channels, one channel after the other, as 32-bit floats.
+  func write(_ channels: [[AUValue]], to url: URL) throws {
+    try FileManager.default.createDirectory(at: referenceDirectory, withIntermediateDirectories: true)
+    try Array(channels.joined()).withUnsafeBufferPointer { Data(buffer: $0) }.write(to: url)
+  }
+
+  /// Read samples written by `write`.
+  func read(from url: URL) throws -> [AUValue] {
+    let data = try Data(contentsOf: url)
+    return data.withUnsafeBytes { Array($0.bindMemory(to: AUValue.self)) }
+  }
+}
@@ -1,9 +1,18 @@
 // Copyright © 2021 Brad Howes. All rights reserved.
 
 #import <XCTest/XCTest.h>
+#import <algorithm>
+#import <cfloat>
 #import <cmath>
+#import <memory>
+#import <vector>
 
+#import "../../Sources/Kernel/C++/DelayLine.hpp"
+#import "../../Sources/Kernel/C++/DenormalGuard.hpp"
+#import "../../Sources/Kernel/C++/Engine.hpp"
 #import "../../Sources/Kernel/C++/Kernel.hpp"
+#import "../../Sources/Kernel/C++/QuadratureLFO.hpp"
+#import "../../Sources/Kernel/C++/RenderStatistics.hpp"
 
 @import ParameterAddress;
 
@@ -43,6 +52,862 @@
   XCTAssertEqualWithAccuracy(kernel->getParameterValue(ParameterAddressOdd90), 0.0, 0.001);
   kernel->setParameterValue(ParameterAddressOdd90, 1.0, 0);
   XCTAssertEqualWithAccuracy(kernel->getParameterValue(ParameterAddressOdd90), 1.0, 0.001);
+
+  XCTAssertEqualWithAccuracy(kernel->getParameterValue(ParameterAddressQuality), 2.0, 0.001);
+  kernel->setParameterValue(ParameterAddressQuality, 1.0, 0);
+  XCTAssertEqualWithAccuracy(kernel->getParameterValue(ParameterAddressQuality), 1.0, 0.001);
+  kernel->setParameterValue(ParameterAddressQuality, 9.0, 0);
+  XCTAssertEqualWithAccuracy(kernel->getParameterValue(ParameterAddressQuality), 3.0, 0.001);
+
+  XCTAssertEqualWithAccuracy(kernel->getParameterValue(ParameterAddressVoices), 1.0, 0.001);
+  kernel->setParameterValue(ParameterAddressVoices, 4.0, 0);
+  XCTAssertEqualWithAccuracy(kernel->getParameterValue(ParameterAddressVoices), 4.0, 0.001);
+  kernel->setParameterValue(ParameterAddressVoices, 20.0, 0);
+  XCTAssertEqualWithAccuracy(kernel->getParameterValue(ParameterAddressVoices), 8.0, 0.001);
+
+  XCTAssertEqualWithAccuracy(kernel->getParameterValue(ParameterAddressFeedback), 0.0, 0.001);
+  kernel->setParameterValue(ParameterAddressFeedback, -60.0, 0);
+  XCTAssertEqualWithAccuracy(kernel->getParameterValue(ParameterAddressFeedback), -60.0, 0.001);
+  kernel->setParameterValue(ParameterAddressFeedback, 120.0, 0);
+  XCTAssertEqualWithAccuracy(kernel->getParameterValue(ParameterAddressFeedback), 95.0, 0.001);
+
+  XCTAssertEqualWithAccuracy(kernel->getParameterValue(ParameterAddressDamping), 0.0, 0.001);
+  kernel->setParameterValue(ParameterAddressDamping, 40.0, 0);
+  XCTAssertEqualWithAccuracy(kernel->getParameterValue(ParameterAddressDamping), 40.0, 0.001);
+  kernel->setParameterValue(ParameterAddressDamping, 150.0, 0);
+  XCTAssertEqualWithAccuracy(kernel->getParameterValue(ParameterAddressDamping), 100.0, 0.001);
+}
+
+- (void)testBulkParameterChanges {
+  Kernel kernel("bulk");
+  kernel.setOfflineFormat(2, 44100.0, 100, 20.0);
+  Kernel::ParameterValue values[] = {
+    {ParameterAddressDelay, 12.0, 0},
+    {ParameterAddressWet, 40.0, 100},
+    {ParameterAddressVoices, 3.0, 0},
+    {ParameterAddressDelay, 15.0, 0},
+    {Chorus::parameterCount, 1.0, 0}
+  };
+  kernel.setParameters(values, 5);
+
+  // Later changes to the same parameter win, and addresses without a parameter are ignored.
+  XCTAssertEqualWithAccuracy(kernel.getParameterValue(ParameterAddressDelay), 15.0, 0.001);
+  XCTAssertEqualWithAccuracy(kernel.getParameterValue(ParameterAddressWet), 40.0, 0.001);
+  XCTAssertEqualWithAccuracy(kernel.getParameterValue(ParameterAddressVoices), 3.0, 0.001);
+  XCTAssertEqual(kernel.getParameterValue(Chorus::parameterCount), 0.0);
+}
+
+- (void)testOfflineRender {
+  constexpr size_t frameCount = 5000;
+  constexpr size_t channelCount = 2;
+  std::vector<AUValue> left(frameCount), right(frameCount), interleaved(frameCount * channelCount);
+  uint32_t seed = 12345;
+  for (size_t frame = 0; frame < frameCount; ++frame) {
+    seed = seed * 1664525 + 1013904223;
+    left[frame] = AUValue(seed >> 8) / AUValue(1 << 24) * 2.0 - 1.0;
+    right[frame] = -left[frame];
+    interleaved[frame * 2] = left[frame];
+    interleaved[frame * 2 + 1] = right[frame];
+  }
+
+  // The wet mix ramps to zero over 1000 frames starting at frame 2000.
+  Kernel::AutomationEvent events[] = {
+    {0, ParameterAddressRate, 2.5, 0},
+    {0, ParameterAddressDelay, 10.0, 0},
+    {0, ParameterAddressDepth, 50.0, 0},
+    {0, ParameterAddressDry, 50.0, 0},
+    {0, ParameterAddressWet, 50.0, 0},
+    {0, ParameterAddressOdd90, 1.0, 0},
+    {2000, ParameterAddressWet, 0.0, 1000}
+  };
+  constexpr size_t eventCount = sizeof(events) / sizeof(events[0]);
+
+  Kernel planar("planar");
+  planar.setOfflineFormat(channelCount, 44100.0, 512, 20.0);
+  std::vector<AUValue> leftOut(frameCount), rightOut(frameCount);
+  const AUValue* inputs[] = {left.data(), right.data()};
+  AUValue* outputs[] = {leftOut.data(), rightOut.data()};
+  planar.renderOffline(inputs, outputs, frameCount, events, eventCount);
+
+  Kernel packed("interleaved");
+  packed.setOfflineFormat(channelCount, 44100.0, 512, 20.0);
+  packed.renderOfflineInterleaved(interleaved.data(), interleaved.data(), frameCount, events, eventCount);
+
+  for (size_t frame = 0; frame < frameCount; ++frame) {
+    XCTAssertEqual(leftOut[frame], interleaved[frame * 2]);
+    XCTAssertEqual(rightOut[frame], interleaved[frame * 2 + 1]);
+  }
+
+  // Once the wet mix ramp is done, the output is just the dry signal.
+  for (size_t frame = 3000; frame < frameCount; ++frame) {
+    XCTAssertEqualWithAccuracy(leftOut[frame], 0.5 * left[frame], 1.0e-6);
+  }
+}
+
+- (void)testPresetSnapshot {
+  std::vector<AUValue> samples(4000);
+  for (size_t frame = 0; frame < samples.size(); ++frame) samples[frame] = AUValue(0.5 * std::sin(0.05 * frame));
+  std::vector<AUValue> rendered(samples.size());
+  const AUValue* inputs[] = {samples.data()};
+  AUValue* outputs[] = {rendered.data()};
+
+  Kernel kernel("presets");
+  kernel.setOfflineFormat(1, 44100.0, 512, 20.0);
+  kernel.postPreset({1.0, 8.0, 40.0, 60.0, 70.0, 0.0, 1.0, 3.0, 0.0, 0.0, 0});
+  kernel.renderOffline(inputs, outputs, 100);
+  XCTAssertEqualWithAccuracy(kernel.getParameterValue(ParameterAddressRate), 1.0, 0.001);
+  XCTAssertEqualWithAccuracy(kernel.getParameterValue(ParameterAddressDelay), 8.0, 0.001);
+  XCTAssertEqualWithAccuracy(kernel.getParameterValue(ParameterAddressDry), 60.0, 0.001);
+  XCTAssertEqualWithAccuracy(kernel.getParameterValue(ParameterAddressWet), 70.0, 0.001);
+  XCTAssertEqualWithAccuracy(kernel.getParameterValue(ParameterAddressQuality), 1.0, 0.001);
+  XCTAssertEqualWithAccuracy(kernel.getParameterValue(ParameterAddressVoices), 3.0, 0.001);
+
+  // Crossfade: the wet signal is silent at the midpoint, where the voice count switches.
+  kernel.postPreset({2.0, 12.0, 50.0, 100.0, 100.0, 1.0, 2.0, 1.0, 0.0, 0.0, 2000});
+  kernel.renderOffline(inputs, outputs, 999);
+  XCTAssertEqualWithAccuracy(kernel.getParameterValue(ParameterAddressVoices), 3.0, 0.001);
+  kernel.renderOffline(inputs, outputs, 2);
+  // Halfway through its ramp from 60% to 100%
+  XCTAssertEqualWithAccuracy(rendered[1], 0.8 * samples[1], 1.0e-4);
+  XCTAssertEqualWithAccuracy(kernel.getParameterValue(ParameterAddressVoices), 1.0, 0.001);
+  kernel.renderOffline(inputs, outputs, 1000);
+  XCTAssertEqualWithAccuracy(kernel.getParameterValue(ParameterAddressDry), 100.0, 0.001);
+  XCTAssertEqualWithAccuracy(kernel.getParameterValue(ParameterAddressWet), 100.0, 0.001);
+}
+
+- (void)testPostedPresetValues {
+  std::vector<AUValue> samples(1000, 0.25);
+  const AUValue* inputs[] = {samples.data()};
+  AUValue* outputs[] = {samples.data()};
+
+  // The values of a posted preset are reported before the render thread switches to them.
+  Kernel kernel("posted presets");
+  kernel.setOfflineFormat(1, 44100.0, 512, 20.0);
+  kernel.postPreset({1.0, 8.0, 40.0, 60.0, 70.0, 0.0, 1.0, 3.0, 25.0, 10.0, 600});
+  XCTAssertEqual(kernel.getPostedParameterValue(ParameterAddressWet), 70.0);
+  XCTAssertEqual(kernel.getPostedParameterValue(ParameterAddressFeedback), 25.0);
+  kernel.renderOffline(inputs, outputs, 100);
+  XCTAssertEqual(kernel.getPostedParameterValue(ParameterAddressVoices), 3.0);
+  XCTAssertNotEqualWithAccuracy(kernel.getParameterValue(ParameterAddressVoices), 3.0, 0.001);
+
+  // Past the midpoint of the crossfade they are the engine's own, and a later change still wins.
+  kernel.renderOffline(inputs, outputs, 300);
+  XCTAssertEqualWithAccuracy(kernel.getParameterValue(ParameterAddressVoices), 3.0, 0.001);
+  kernel.postParameterValue(ParameterAddressWet, 20.0);
+  XCTAssertEqual(kernel.getPostedParameterValue(ParameterAddressWet), 20.0);
+  XCTAssertEqualWithAccuracy(kernel.getPostedParameterValue(ParameterAddressDelay), 8.0, 0.001);
+}
+
+- (void)testKernelVariantsMatch {
+  auto render = [](auto& kernel) {
+    std::vector<AUValue> left(6000);
+    std::vector<AUValue> right(left.size());
+    for (size_t frame = 0; frame < left.size(); ++frame) {
+      left[frame] = AUValue(0.5 * std::sin(0.05 * frame));
+      right[frame] = AUValue(0.3 * std::sin(0.031 * frame));
+    }
+    const AUValue* inputs[] = {left.data(), right.data()};
+    AUValue* outputs[] = {left.data(), right.data()};
+    kernel.setOfflineFormat(2, 44100.0, 512, 20.0);
+    kernel.setParameterValue(ParameterAddressDelay, 8.0, 0);
+    kernel.setParameterValue(ParameterAddressDepth, 50.0, 0);
+    kernel.setParameterValue(ParameterAddressWet, 50.0, 0);
+    kernel.setParameterValue(ParameterAddressVoices, 3.0, 0);
+    kernel.setParameterValue(ParameterAddressOdd90, 1.0, 0);
+    typename std::decay_t<decltype(kernel)>::AutomationEvent ramp[] = {{2000, ParameterAddressDelay, 12.0, 2000}};
+    kernel.renderOffline(inputs, outputs, left.size(), ramp, 1);
+    left.insert(left.end(), right.begin(), right.end());
+    return left;
+  };
+
+  auto kernel = std::make_unique<Kernel>("float");
+  auto doubleKernel = std::make_unique<DoubleKernel>("double");
+  auto fixedKernel = std::make_unique<FixedKernel>("fixed");
+  auto expected = render(*kernel);
+  auto precise = render(*doubleKernel);
+  auto fixed = render(*fixedKernel);
+  for (size_t index = 0; index < expected.size(); ++index) {
+    XCTAssertEqualWithAccuracy(precise[index], expected[index], 1.0e-5);
+    XCTAssertEqual(fixed[index], expected[index]);
+  }
+}
+
+- (void)testEngineMatchesKernel {
+  auto render = [](auto& renderer, auto delay, auto wet) {
+    std::vector<AUValue> samples(4096);
+    for (size_t frame = 0; frame < samples.size(); ++frame) samples[frame] = AUValue(0.5 * std::sin(0.05 * frame));
+    const AUValue* inputs[] = {samples.data()};
+    AUValue* outputs[] = {samples.data()};
+    renderer.setOfflineFormat(1, 48000.0, 256, 20.0);
+    renderer.setParameterValue(delay, 10.0, 0);
+    renderer.setParameterValue(wet, 60.0, 0);
+    typename std::decay_t<decltype(renderer)>::AutomationEvent ramp[] = {{1000, delay, 5.0, 1500}};
+    renderer.renderOffline(inputs, outputs, samples.size(), ramp, 1);
+    return samples;
+  };
+
+  // The engine needs nothing from the audio unit, not even the parameter addresses.
+  Chorus::Engine<AUValue> engine;
+  Kernel kernel("engine");
+  auto expected = render(kernel, AUParameterAddress(ParameterAddressDelay), AUParameterAddress(ParameterAddressWet));
+  auto rendered = render(engine, Chorus::Address(Chorus::Parameter::delay), Chorus::Address(Chorus::Parameter::wet));
+  for (size_t index = 0; index < expected.size(); ++index) XCTAssertEqual(rendered[index], expected[index]);
+  XCTAssertEqual(engine.getParameterValue(Chorus::Address(Chorus::Parameter::delay)), 5.0);
+}
+
+- (void)testBypassDrainsTail {
+  std::vector<AUValue> samples(4096);
+  for (size_t frame = 0; frame < samples.size(); ++frame) samples[frame] = AUValue(0.5 * std::sin(0.05 * frame));
+  std::vector<AUValue> rendered(samples.size());
+  const AUValue* inputs[] = {samples.data()};
+  AUValue* outputs[] = {rendered.data()};
+
+  Kernel kernel("bypass");
+  kernel.setOfflineFormat(1, 44100.0, 512, 20.0);
+  kernel.setParameterValue(ParameterAddressDelay, 10.0, 0);
+  kernel.setParameterValue(ParameterAddressDepth, 50.0, 0);
+  kernel.setParameterValue(ParameterAddressWet, 100.0, 0);
+  XCTAssertEqualWithAccuracy(kernel.tailTime(), 0.015, 1.0e-6);
+  kernel.renderOffline(inputs, outputs, 1024);
+
+  // The first 15 ms still carry the wet signal, after which the output is the input.
+  kernel.setBypass(true);
+  kernel.renderOffline(inputs, outputs, 512);
+  XCTAssertFalse(kernel.isBypassIdle());
+  kernel.renderOffline(inputs, outputs, samples.size());
+  XCTAssertTrue(kernel.isBypassIdle());
+  for (size_t frame = 1024; frame < samples.size(); ++frame) XCTAssertEqual(rendered[frame], samples[frame]);
+
+  // Nothing from before the bypass is heard once it ends.
+  kernel.setBypass(false);
+  std::vector<AUValue> silence(samples.size(), 0.0);
+  inputs[0] = silence.data();
+  kernel.renderOffline(inputs, outputs, samples.size());
+  XCTAssertFalse(kernel.isBypassIdle());
+  for (auto sample : rendered) XCTAssertEqual(sample, 0.0);
+}
+
+- (void)testSilentInputSkipsRendering {
+  std::vector<AUValue> signal(3000);
+  for (size_t frame = 0; frame < signal.size(); ++frame) signal[frame] = AUValue(0.5 * std::sin(0.05 * frame));
+  std::vector<AUValue> silence(20000, 0.0);
+  // Not quite silent, so it is rendered in full.
+  std::vector<AUValue> almostSilence(silence.size(), 1.0e-30f);
+
+  auto render = [&](Kernel& kernel, std::vector<AUValue>& quiet, bool& idle) {
+    std::vector<AUValue> rendered(signal.size());
+    const AUValue* inputs[] = {signal.data()};
+    AUValue* outputs[] = {rendered.data()};
+    kernel.setOfflineFormat(1, 44100.0, 512, 20.0);
+    kernel.setParameterValue(ParameterAddressDepth, 50.0, 0);
+    kernel.renderOffline(inputs, outputs, signal.size());
+    inputs[0] = quiet.data();
+    outputs[0] = quiet.data();
+    kernel.renderOffline(inputs, outputs, quiet.size());
+    idle = kernel.isSilenceIdle();
+    inputs[0] = signal.data();
+    outputs[0] = rendered.data();
+    kernel.renderOffline(inputs, outputs, signal.size());
+    return rendered;
+  };
+
+  Kernel skipping("silence");
+  Kernel rendering("reference");
+  bool idle = false;
+  auto skipped = render(skipping, silence, idle);
+  XCTAssertTrue(idle);
+  XCTAssertFalse(skipping.isSilenceIdle());
+  auto expected = render(rendering, almostSilence, idle);
+  XCTAssertFalse(idle);
+  for (auto sample : silence) XCTAssertEqual(sample, 0.0);
+
+  // The LFOs kept going while idle, so the output is the same once the input returns.
+  for (size_t frame = 0; frame < signal.size(); ++frame) {
+    XCTAssertEqualWithAccuracy(skipped[frame], expected[frame], 1.0e-5);
+  }
+}
+
+- (void)testRampsAreTrackedPerParameter {
+  std::vector<AUValue> samples(3000, 0.25);
+  const AUValue* inputs[] = {samples.data()};
+  AUValue* outputs[] = {samples.data()};
+
+  // The LFOs ramp their own rate, so a rate ramp does not need per-frame rendering.
+  Kernel kernel("ramps");
+  kernel.setOfflineFormat(1, 44100.0, 512, 20.0);
+  kernel.setInstrumentationEnabled(true);
+  Kernel::AutomationEvent rateRamp[] = {{0, ParameterAddressRate, 5.0, 2000}};
+  kernel.renderOffline(inputs, outputs, samples.size(), rateRamp, 1);
+  XCTAssertEqual(kernel.renderStatistics().snapshot().rampFrameCount, 0);
+
+  // Overlapping ramps are split where each one ends and only cover the frames that something is ramping.
+  Kernel::AutomationEvent mixRamps[] = {{100, ParameterAddressWet, 20.0, 500}, {200, ParameterAddressDry, 80.0, 1000}};
+  kernel.renderOffline(inputs, outputs, samples.size(), mixRamps, 2);
+  auto snapshot = kernel.renderStatistics().snapshot();
+  XCTAssertEqual(snapshot.rampFrameCount, 1100);
+  XCTAssertEqualWithAccuracy(kernel.getParameterValue(ParameterAddressWet), 20.0, 0.001);
+  XCTAssertEqualWithAccuracy(kernel.getParameterValue(ParameterAddressDry), 80.0, 0.001);
+}
+
+- (void)testInterleavedRenderMatchesPlanar {
+  constexpr size_t frameCount = 1500;
+  constexpr size_t channelCount = 3;
+  std::vector<std::vector<AUValue>> planar(channelCount, std::vector<AUValue>(frameCount));
+  std::vector<AUValue> interleaved(frameCount * channelCount);
+  uint32_t seed = 54321;
+  for (size_t frame = 0; frame < frameCount; ++frame) {
+    for (size_t channel = 0; channel < channelCount; ++channel) {
+      seed = seed * 1664525 + 1013904223;
+      planar[channel][frame] = AUValue(seed >> 8) / AUValue(1 << 24) * 2.0 - 1.0;
+      interleaved[frame * channelCount + channel] = planar[channel][frame];
+    }
+  }
+
+  Kernel::AutomationEvent events[] = {
+    {0, ParameterAddressOdd90, 1.0, 0},
+    {0, ParameterAddressVoices, 2.0, 0},
+    {400, ParameterAddressDepth, 0.0, 0},
+    {900, ParameterAddressDelay, 5.0, 300}
+  };
+  constexpr size_t eventCount = sizeof(events) / sizeof(events[0]);
+
+  Kernel first("planar");
+  first.setOfflineFormat(channelCount, 48000.0, 256, 20.0);
+  AUValue* buffers[] = {planar[0].data(), planar[1].data(), planar[2].data()};
+  first.renderOffline(buffers, buffers, frameCount, events, eventCount);
+
+  Kernel second("interleaved");
+  second.setOfflineFormat(channelCount, 48000.0, 256, 20.0);
+  second.renderOfflineInterleaved(interleaved.data(), interleaved.data(), frameCount, events, eventCount);
+
+  for (size_t frame = 0; frame < frameCount; ++frame) {
+    for (size_t channel = 0; channel < channelCount; ++channel) {
+      XCTAssertEqual(planar[channel][frame], interleaved[frame * channelCount + channel]);
+    }
+  }
+}
+
+- (void)testParallelRenderMatchesSerial {
+  constexpr size_t frameCount = 2000;
+  constexpr size_t channelCount = 8;
+  std::vector<std::vector<AUValue>> samples(channelCount, std::vector<AUValue>(frameCount));
+  uint32_t seed = 12345;
+  for (auto& channel : samples) {
+    for (auto& sample : channel) {
+      seed = seed * 1664525 + 1013904223;
+      sample = AUValue(seed >> 8) / AUValue(1 << 24) * 2.0 - 1.0;
+    }
+  }
+
+  Kernel::AutomationEvent events[] = {
+    {0, ParameterAddressDepth, 50.0, 0},
+    {0, ParameterAddressOdd90, 1.0, 0},
+    {0, ParameterAddressVoices, 3.0, 0},
+    {700, ParameterAddressDelay, 15.0, 500}
+  };
+  constexpr size_t eventCount = sizeof(events) / sizeof(events[0]);
+
+  auto render = [&](Kernel& kernel) {
+    std::vector<std::vector<AUValue>> rendered(channelCount, std::vector<AUValue>(frameCount));
+    const AUValue* inputs[channelCount];
+    AUValue* outputs[channelCount];
+    for (size_t channel = 0; channel < channelCount; ++channel) {
+      inputs[channel] = samples[channel].data();
+      outputs[channel] = rendered[channel].data();
+    }
+    kernel.setOfflineFormat(channelCount, 44100.0, 512, 20.0);
+    kernel.renderOffline(inputs, outputs, frameCount, events, eventCount);
+    return rendered;
+  };
+
+  Kernel serial("serial");
+  Kernel parallel("parallel");
+  parallel.setRenderWorkers(3, 4);
+  XCTAssertEqual(parallel.renderWorkerCount(), 3);
+
+  auto expected = render(serial);
+  auto actual = render(parallel);
+  for (size_t channel = 0; channel < channelCount; ++channel) {
+    for (size_t frame = 0; frame < frameCount; ++frame) {
+      XCTAssertEqual(actual[channel][frame], expected[channel][frame]);
+    }
+  }
+}
+
+- (void)testBussesRenderTheSameCycle {
+  constexpr AUAudioFrameCount frameCount = 512;
+  AVAudioFormat* format = [[AVAudioFormat alloc] initStandardFormatWithSampleRate:48000.0 channels:2];
+  AVAudioPCMBuffer* input = [[AVAudioPCMBuffer alloc] initWithPCMFormat:format frameCapacity:frameCount];
+  AVAudioPCMBuffer* outputs[] = {
+    [[AVAudioPCMBuffer alloc] initWithPCMFormat:format frameCapacity:frameCount],
+    [[AVAudioPCMBuffer alloc] initWithPCMFormat:format frameCapacity:frameCount]
+  };
+  input.frameLength = frameCount;
+  for (auto output : outputs) output.frameLength = frameCount;
+
+  // Both busses pull the same input, so they must render the same output.
+  const AudioBufferList* inputBuffers = input.audioBufferList;
+  AURenderPullInputBlock pullInputBlock = ^AUAudioUnitStatus(AudioUnitRenderActionFlags*, const AudioTimeStamp*,
+                                                             AUAudioFrameCount count, NSInteger,
+                                                             AudioBufferList* bufferList) {
+    auto byteCount = UInt32(count * sizeof(AUValue));
+    for (UInt32 index = 0; index < std::min(bufferList->mNumberBuffers, inputBuffers->mNumberBuffers); ++index) {
+      if (bufferList->mBuffers[index].mData != nullptr) {
+        memcpy(bufferList->mBuffers[index].mData, inputBuffers->mBuffers[index].mData, byteCount);
+      } else {
+        bufferList->mBuffers[index].mData = inputBuffers->mBuffers[index].mData;
+      }
+      bufferList->mBuffers[index].mDataByteSize = byteCount;
+    }
+    return noErr;
+  };
+
+  Kernel kernel("busses");
+  kernel.setRenderingFormat(2, format, frameCount, 50.0);
+  kernel.setParameterValue(ParameterAddressDepth, 50.0, 0);
+  kernel.setParameterValue(ParameterAddressOdd90, 1.0, 0);
+  kernel.setParameterValue(ParameterAddressVoices, 3.0, 0);
+  kernel.setParameterValue(ParameterAddressFeedback, 30.0, 0);
+
+  uint32_t seed = 12345;
+  for (int cycle = 0; cycle < 11; ++cycle) {
+    for (AVAudioChannelCount channel = 0; channel < format.channelCount; ++channel) {
+      for (AUAudioFrameCount frame = 0; frame < frameCount; ++frame) {
+        seed = seed * 1664525 + 1013904223;
+        input.floatChannelData[channel][frame] = AUValue(seed >> 8) / AUValue(1 << 24) * 2.0 - 1.0;
+      }
+    }
+
+    // A delay ramp that starts part way into the cycle, so that the busses replay ramping and steady segments. After
+    // a jump to 40 ms, the ramp down to 2 ms ends part way into cycle 9 and leaves the delay lines more than four times
+    // larger than they need to be, which shrinks them while bus 1 still has the cycle to replay.
+    AudioTimeStamp timestamp{};
+    timestamp.mSampleTime = cycle * frameCount;
+    timestamp.mFlags = kAudioTimeStampSampleTimeValid;
+    AURenderEvent ramp{};
+    if (cycle < 8) {
+      ramp.parameter = {nullptr, AUEventSampleTime(timestamp.mSampleTime) + 200, AURenderEventParameterRamp,
+                        {0, 0, 0}, 300, ParameterAddressDelay, cycle % 2 ? 14.0f : 8.0f};
+    } else {
+      ramp.parameter = {nullptr, AUEventSampleTime(timestamp.mSampleTime) + (cycle == 8 ? 0 : 100),
+                        AURenderEventParameterRamp, {0, 0, 0}, AUAudioFrameCount(cycle == 8 ? 0 : 300),
+                        ParameterAddressDelay, cycle == 8 ? 40.0f : 2.0f};
+    }
+    for (NSInteger bus = 0; bus < 2; ++bus) {
+      XCTAssertEqual(kernel.processAndRender(&timestamp, frameCount, bus, outputs[bus].mutableAudioBufferList,
+                                             cycle < 10 ? &ramp : nullptr, pullInputBlock), noErr);
+    }
+
+    for (AVAudioChannelCount channel = 0; channel < format.channelCount; ++channel) {
+      for (AUAudioFrameCount frame = 0; frame < frameCount; ++frame) {
+        XCTAssertEqual(outputs[1].floatChannelData[channel][frame], outputs[0].floatChannelData[channel][frame]);
+      }
+    }
+  }
+}
+
+- (void)testFeedbackEchoes {
+  constexpr size_t frameCount = 200;
+  std::vector<AUValue> left(frameCount), right(frameCount);
+  left[0] = 1.0;
+  right[0] = 1.0;
+
+  // A delay of 0.25 ms is 12 samples at 48 kHz.
+  Kernel kernel("feedback");
+  kernel.setOfflineFormat(2, 48000.0, 512, 50.0);
+  kernel.setParameterValue(ParameterAddressDelay, 0.25, 0);
+  kernel.setParameterValue(ParameterAddressDepth, 0.0, 0);
+  kernel.setParameterValue(ParameterAddressDry, 0.0, 0);
+  kernel.setParameterValue(ParameterAddressWet, 100.0, 0);
+  kernel.setParameterValue(ParameterAddressFeedback, 50.0, 0);
+  AUValue* buffers[] = {left.data(), right.data()};
+  kernel.renderOffline(buffers, buffers, frameCount);
+
+  // Each trip around the loop takes the delay, and halves the echo.
+  XCTAssertEqualWithAccuracy(left[12], 1.0, 1.0e-6);
+  XCTAssertEqualWithAccuracy(left[24], 0.5, 1.0e-6);
+  XCTAssertEqualWithAccuracy(left[36], 0.25, 1.0e-6);
+  XCTAssertEqualWithAccuracy(right[36], 0.25, 1.0e-6);
+  XCTAssertEqual(left[18], 0.0);
+  XCTAssertGreaterThan(kernel.tailTime(), 0.25 / 1000.0);
+}
+
+- (void)testFeedbackDamping {
+  constexpr size_t frameCount = 200;
+  auto secondEcho = [](AUValue damping) {
+    std::vector<AUValue> samples(frameCount);
+    samples[0] = 1.0;
+    Kernel kernel("damping");
+    kernel.setOfflineFormat(1, 48000.0, 512, 50.0);
+    kernel.setParameterValue(ParameterAddressDelay, 0.25, 0);
+    kernel.setParameterValue(ParameterAddressDepth, 0.0, 0);
+    kernel.setParameterValue(ParameterAddressDry, 0.0, 0);
+    kernel.setParameterValue(ParameterAddressWet, 100.0, 0);
+    kernel.setParameterValue(ParameterAddressFeedback, 50.0, 0);
+    kernel.setParameterValue(ParameterAddressDamping, damping, 0);
+    AUValue* buffers[] = {samples.data()};
+    kernel.renderOffline(buffers, buffers, frameCount);
+    return *std::max_element(samples.begin() + 18, samples.end());
+  };
+
+  // The low-pass in the loop smears the recirculated impulse, so its peak drops as the damping goes up.
+  XCTAssertEqualWithAccuracy(secondEcho(0.0), 0.5, 1.0e-6);
+  XCTAssertLessThan(secondEcho(50.0), 0.25);
+  XCTAssertLessThan(secondEcho(100.0), secondEcho(50.0));
+}
+
+- (void)testPostedParameterValues {
+  Kernel* kernel = new Kernel("blah");
+  AVAudioFormat* format = [[AVAudioFormat alloc] initStandardFormatWithSampleRate:44100.0 channels:2];
+  kernel->setRenderingFormat(1, format, 100, 20.0);
+
+  kernel->setParameterValue(ParameterAddressWet, 60.0, 0);
+  XCTAssertTrue(kernel->postParameterValue(ParameterAddressWet, 70.0));
+  XCTAssertTrue(kernel->postParameterValue(ParameterAddressWet, 80.0));
+
+  // Not applied until the render thread gets to it, but visible to other threads
+  XCTAssertEqualWithAccuracy(kernel->getParameterValue(ParameterAddressWet), 60.0, 0.001);
+  XCTAssertEqualWithAccuracy(kernel->getPostedParameterValue(ParameterAddressWet), 80.0, 0.001);
+  XCTAssertEqualWithAccuracy(kernel->getPostedParameterValue(ParameterAddressDry),
+                             kernel->getParameterValue(ParameterAddressDry), 0.001);
+  XCTAssertFalse(kernel->postParameterValue(Kernel::maxParameterCount, 1.0));
+}
+
+- (void)testPostedParameterValuesAreNeverDropped {
+  Kernel kernel("sweep");
+  kernel.setOfflineFormat(2, 44100.0, 100, 20.0);
+
+  // A knob sweep while the render thread is not running.
+  for (int index = 0; index < 1000; ++index) {
+    XCTAssertTrue(kernel.postParameterValue(ParameterAddressWet, AUValue(index % 100)));
+  }
+  XCTAssertEqualWithAccuracy(kernel.getPostedParameterValue(ParameterAddressWet), 99.0, 0.001);
+
+  std::vector<AUValue> left(100), right(100);
+  AUValue* buffers[] = {left.data(), right.data()};
+  kernel.renderOffline(buffers, buffers, left.size());
+  XCTAssertEqualWithAccuracy(kernel.getParameterValue(ParameterAddressWet), 99.0, 0.001);
+  XCTAssertEqualWithAccuracy(kernel.getPostedParameterValue(ParameterAddressWet), 99.0, 0.001);
+}
+
+- (void)testDelayLineIntegralRead {
+  Chorus::DelayLinePool<AUValue> pool;
+  pool.bind(1, 16.0);
+  auto& delayLine = pool[0];
+  for (int index = 0; index < 10; ++index) {
+    delayLine.write(index);
+  }
+  XCTAssertEqualWithAccuracy(delayLine.read(1.0), 8.0, 0.0001);
+  XCTAssertEqualWithAccuracy(delayLine.read(3.0), 6.0, 0.0001);
+  XCTAssertEqualWithAccuracy(delayLine.read(3.5), 5.5, 0.0001);
+}
+
+- (void)testDelayLineBlockMatchesScalar {
+  constexpr size_t lanes = 8;
+  Chorus::DelayLinePool<AUValue> pool;
+  pool.bind(2, 100.0);
+  auto& blockLine = pool[0];
+  auto& scalarLine = pool[1];
+  for (int block = 0; block < 100; ++block) {
+    AUValue input[lanes];
+    AUValue delays[lanes];
+    AUValue output[lanes];
+    for (size_t frame = 0; frame < lanes; ++frame) {
+      auto time = block * lanes + frame;
+      input[frame] = std::sin(time * 0.3);
+      delays[frame] = 1.0 + 25.0 * (1.0 + std::sin(time * 0.01));
+    }
+
+    Chorus::Taps<AUValue, lanes> taps;
+    taps.compute<Chorus::Interpolator::cubic4thOrder>(delays, lanes, blockLine.maxDelay(lanes));
+    blockLine.process<Chorus::Interpolator::cubic4thOrder>(input, taps, lanes, output);
+
+    for (size_t frame = 0; frame < lanes; ++frame) {
+      scalarLine.write(input[frame]);
+      XCTAssertEqualWithAccuracy(output[frame], scalarLine.read(delays[frame]), 1.0e-6);
+    }
+  }
+}
+
+- (void)testDelayLineMultipleTapsMatchSum {
+  constexpr size_t lanes = 8;
+  Chorus::DelayLinePool<AUValue> pool;
+  pool.bind(3, 100.0);
+  for (int block = 0; block < 50; ++block) {
+    AUValue input[lanes];
+    AUValue delays[2][lanes];
+    for (size_t frame = 0; frame < lanes; ++frame) {
+      auto time = block * lanes + frame;
+      input[frame] = std::sin(time * 0.3);
+      delays[0][frame] = 1.0 + 25.0 * (1.0 + std::sin(time * 0.01));
+      delays[1][frame] = 1.0 + 25.0 * (1.0 + std::cos(time * 0.013));
+    }
+
+    Chorus::Taps<AUValue, lanes> taps[2];
+    AUValue outputs[3][lanes];
+    for (size_t tap = 0; tap < 2; ++tap) {
+      taps[tap].compute<Chorus::Interpolator::cubic4thOrder>(delays[tap], lanes, pool[0].maxDelay(lanes));
+      pool[tap].process<Chorus::Interpolator::cubic4thOrder>(input, taps[tap], lanes, outputs[tap]);
+    }
+    pool[2].process<Chorus::Interpolator::cubic4thOrder>(input, taps, 2, lanes, outputs[2]);
+
+    for (size_t frame = 0; frame < lanes; ++frame) {
+      XCTAssertEqualWithAccuracy(outputs[2][frame], outputs[0][frame] + outputs[1][frame], 1.0e-6);
+    }
+  }
+}
+
+- (void)testQuadratureLFOMatchesSinusoid {
+  constexpr double sampleRate = 48000.0;
+  constexpr double frequency = 5.1;
+  Chorus::QuadratureLFO<AUValue> lfo;
+  lfo.setSampleRate(sampleRate);
+  lfo.setFrequency(frequency, 0);
+
+  AUValue values[512];
+  AUValue quadPhaseValues[512];
+  size_t time = 0;
+  for (int block = 0; block < 1000; ++block) {
+    lfo.fill(values, quadPhaseValues, 512);
+    for (size_t frame = 0; frame < 512; ++frame, ++time) {
+      auto phase = 2.0 * M_PI * frequency * time / sampleRate;
+      XCTAssertEqualWithAccuracy(values[frame], std::sin(phase), 1.0e-4);
+      XCTAssertEqualWithAccuracy(quadPhaseValues[frame], std::cos(phase), 1.0e-4);
+    }
+  }
+}
+
+- (void)testQuadratureLFOControlInterval {
+  constexpr double sampleRate = 192000.0;
+  constexpr double frequency = 20.0;
+  Chorus::QuadratureLFO<AUValue> lfo;
+  lfo.setSampleRate(sampleRate);
+  lfo.setFrequency(frequency, 0);
+  lfo.setControlInterval(4);
+
+  AUValue values[510];
+  AUValue quadPhaseValues[510];
+  size_t time = 0;
+  for (int block = 0; block < 1000; ++block) {
+    lfo.fill(values, quadPhaseValues, 510);
+    for (size_t frame = 0; frame < 510; ++frame, ++time) {
+      auto phase = 2.0 * M_PI * frequency * time / sampleRate;
+      XCTAssertEqualWithAccuracy(values[frame], std::sin(phase), 1.0e-4);
+      XCTAssertEqualWithAccuracy(quadPhaseValues[frame], std::cos(phase), 1.0e-4);
+    }
+  }
+}
+
+- (void)testQuadratureLFOMappedFill {
+  Chorus::QuadratureLFO<AUValue> plain;
+  Chorus::QuadratureLFO<AUValue> mapped;
+  for (auto lfo : {&plain, &mapped}) {
+    lfo->setSampleRate(192000.0);
+    lfo->setFrequency(5.0, 0);
+    lfo->setControlInterval(4);
+  }
+
+  AUValue values[130], quadPhaseValues[130], delays[130], oddDelays[130];
+  for (int block = 0; block < 100; ++block) {
+    plain.fill(values, quadPhaseValues, 130);
+    mapped.fill(delays, oddDelays, 130, 40.0, 100.0);
+    for (size_t frame = 0; frame < 130; ++frame) {
+      XCTAssertEqualWithAccuracy(delays[frame], 100.0 + 40.0 * values[frame], 1.0e-4);
+      XCTAssertEqualWithAccuracy(oddDelays[frame], 100.0 + 40.0 * quadPhaseValues[frame], 1.0e-4);
+    }
+  }
+}
+
+- (void)testQuadratureLFOSkipMatchesFill {
+  Chorus::QuadratureLFO<AUValue> filled;
+  Chorus::QuadratureLFO<AUValue> skipped;
+  for (auto lfo : {&filled, &skipped}) {
+    lfo->setSampleRate(48000.0);
+    lfo->setFrequency(2.0, 0);
+    lfo->setFrequency(7.0, 300);
+  }
+
+  AUValue values[512];
+  AUValue quadPhaseValues[512];
+  for (int block = 0; block < 100; ++block) {
+    filled.fill(values, quadPhaseValues, 512);
+    skipped.skip(512);
+    XCTAssertEqualWithAccuracy(filled.value(), skipped.value(), 1.0e-4);
+    XCTAssertEqualWithAccuracy(filled.quadPhaseValue(), skipped.quadPhaseValue(), 1.0e-4);
+  }
+}
+
+- (void)testDelayLineBlockWriteMatchesScalar {
+  Chorus::DelayLinePool<AUValue> pool;
+  pool.bind(2, 16.0);
+  AUValue input[12];
+  for (int block = 0; block < 5; ++block) {
+    for (int frame = 0; frame < 12; ++frame) {
+      input[frame] = block * 12 + frame;
+      pool[1].write(input[frame]);
+    }
+    pool[0].write(input, 12);
+    for (AUValue delay = 1.0; delay < 12.0; delay += 1.0) {
+      XCTAssertEqual(pool[0].read(delay), pool[1].read(delay));
+    }
+  }
+}
+
+- (void)testDelayLineResizeKeepsRecentSamples {
+  for (size_t from : {64, 1024}) {
+    for (size_t to : {32, 128, 1024}) {
+      for (int writeCount : {20, 700, 1500}) {
+        Chorus::DelayLinePool<AUValue> pool;
+        pool.bind(1, 1024.0);
+        auto& delayLine = pool[0];
+        XCTAssertEqual(delayLine.capacity(), 1024);
+        delayLine.resize(from);
+        for (int index = 1; index <= writeCount; ++index) delayLine.write(AUValue(index));
+        delayLine.resize(to);
+        XCTAssertEqual(delayLine.size(), to);
+
+        size_t kept = std::min(from, to);
+        for (size_t delay = 2; delay + 3 < kept && delay + 2 < size_t(writeCount); ++delay) {
+          XCTAssertEqualWithAccuracy(delayLine.read(AUValue(delay)), AUValue(writeCount - int(delay)), 1.0e-3);
+        }
+      }
+    }
+  }
+}
+
+- (void)testDenormalProtection {
+  volatile AUValue smallest = FLT_MIN;
+  {
+    Chorus::DenormalGuard guard;
+    XCTAssertEqual(smallest * 0.5f, 0.0);
+  }
+  XCTAssertNotEqual(smallest * 0.5f, 0.0);
+
+  Chorus::DelayLinePool<AUValue> pool;
+  pool.bind(1, 64.0);
+  auto& delayLine = pool[0];
+  delayLine.setBias(1.0e-20f);
+  AUValue samples[8] = {smallest * 0.5f};
+  delayLine.write(samples, 8);
+  for (int delay = 0; delay < 8; ++delay) {
+    XCTAssertGreaterThanOrEqual(std::abs(delayLine.read(AUValue(delay))), FLT_MIN);
+  }
+
+  // Compact storage needs no bias: whatever it holds reads back as zero or as a normal float.
+  Chorus::DelayLinePool<AUValue, Chorus::CompactSample> compact;
+  compact.bind(1, 64.0);
+  compact[0].write(samples, 8);
+  for (int delay = 0; delay < 8; ++delay) {
+    auto sample = std::abs(compact[0].read(AUValue(delay)));
+    XCTAssertTrue(sample == 0.0 || sample >= FLT_MIN);
+  }
+}
+
+- (void)testCompactDelayLineStorage {
+  Chorus::DelayLinePool<AUValue> full;
+  Chorus::DelayLinePool<AUValue, int16_t> dithered;
+  Chorus::DelayLinePool<AUValue, Chorus::CompactSample> compact;
+  full.bind(1, 1000.0);
+  dithered.bind(1, 1000.0);
+  compact.bind(1, 1000.0);
+  XCTAssertEqual(compact.capacity() * sizeof(Chorus::CompactSample), full.capacity() * sizeof(AUValue) / 2);
+
+  for (int frame = 0; frame < 2000; ++frame) {
+    auto sample = AUValue(0.8 * std::sin(0.01 * frame));
+    full[0].write(sample);
+    dithered[0].write(sample);
+    compact[0].write(sample);
+    if (frame > 200) {
+      auto delay = AUValue(100.3 + 30.0 * std::sin(0.001 * frame));
+      XCTAssertEqualWithAccuracy(dithered[0].read(delay), full[0].read(delay), 1.0e-4);
+      XCTAssertEqualWithAccuracy(compact[0].read(delay), full[0].read(delay), 1.0e-3);
+    }
+  }
+
+  // The kernel renders the same effect from compact delay lines.
+  std::vector<AUValue> input(4000), fullOutput(4000), compactOutput(4000);
+  for (size_t frame = 0; frame < input.size(); ++frame) input[frame] = AUValue(0.8 * std::sin(0.02 * frame));
+  Kernel::AutomationEvent events[] = {{0, ParameterAddressDepth, 50.0, 0}, {0, ParameterAddressVoices, 2.0, 0}};
+  for (auto enabled : {false, true}) {
+    Kernel kernel("compact");
+    kernel.setCompactDelayLines(enabled);
+    kernel.setOfflineFormat(1, 48000.0, 512, 20.0);
+    const AUValue* inputs[] = {input.data()};
+    AUValue* outputs[] = {enabled ? compactOutput.data() : fullOutput.data()};
+    kernel.renderOffline(inputs, outputs, input.size(), events, 2);
+  }
+  for (size_t frame = 0; frame < input.size(); ++frame) {
+    XCTAssertEqualWithAccuracy(compactOutput[frame], fullOutput[frame], 2.0e-3);
+  }
+
+  // A change of storage made after the format is set waits for the next one.
+  Kernel kernel("switch");
+  kernel.setOfflineFormat(1, 48000.0, 512, 20.0);
+  kernel.setCompactDelayLines(true);
+  std::vector<AUValue> output(input.size());
+  const AUValue* inputs[] = {input.data()};
+  AUValue* outputs[] = {output.data()};
+  kernel.renderOffline(inputs, outputs, input.size(), events, 2);
+  for (size_t frame = 0; frame < input.size(); ++frame) XCTAssertEqual(output[frame], fullOutput[frame]);
+  kernel.setOfflineFormat(1, 48000.0, 512, 20.0);
+  kernel.renderOffline(inputs, outputs, input.size(), events, 2);
+  for (size_t frame = 0; frame < input.size(); ++frame) XCTAssertEqual(output[frame], compactOutput[frame]);
+}
+
+- (void)testCompactDelayLinesAfterReserve {
+  // Changing the storage after reserving, as the bridge does, only rebinds the delay lines.
+  Kernel kernel("reserved");
+  kernel.reserve(8, 96000.0, 4096, 50.0);
+  for (auto enabled : {true, false, true}) {
+    kernel.setCompactDelayLines(enabled);
+    kernel.setOfflineFormat(2, 48000.0, 512, 50.0);
+    XCTAssertFalse(kernel.delayLinesGrew());
+    kernel.setOfflineFormat(8, 96000.0, 4096, 50.0);
+    XCTAssertFalse(kernel.delayLinesGrew());
+  }
+}
+
+- (void)testDelayLinePoolReuse {
+  Chorus::DelayLinePool<AUValue> pool;
+  pool.reserve(8, 9600.0);
+  auto capacity = pool.capacity();
+
+  XCTAssertTrue(pool.bind(2, 4410.0));
+  XCTAssertEqual(pool.size(), 2);
+  XCTAssertEqual(pool[0].size(), 8192);
+  XCTAssertTrue(pool.bind(8, 9600.0));
+  XCTAssertEqual(pool.size(), 8);
+  XCTAssertEqual(pool.capacity(), capacity);
+
+  XCTAssertFalse(pool.bind(16, 9600.0));
+  XCTAssertEqual(pool.size(), 16);
+  XCTAssertGreaterThan(pool.capacity(), capacity);
+}
+
+- (void)testRenderStatistics {
+  Chorus::RenderStatistics stats;
+  for (uint64_t index = 1; index <= 100; ++index) {
+    stats.recordRender(512, index * 1000, 50000);
+  }
+  stats.recordRamp(64);
+
+  auto snapshot = stats.snapshot();
+  XCTAssertEqual(snapshot.renderCount, 100);
+  XCTAssertEqual(snapshot.frameCount, 51200);
+  XCTAssertEqual(snapshot.minDuration, 1000);
+  XCTAssertEqual(snapshot.maxDuration, 100000);
+  XCTAssertEqualWithAccuracy(snapshot.averageDuration, 50500.0, 0.001);
+  XCTAssertGreaterThanOrEqual(snapshot.p99Duration, 90000);
+  XCTAssertLessThanOrEqual(snapshot.p99Duration, 100000);
+  XCTAssertEqual(snapshot.deadlineOverrunCount, 50);
+  XCTAssertEqual(snapshot.rampRenderCount, 1);
+  XCTAssertEqual(snapshot.rampFrameCount, 64);
+
+  stats.reset();
+  snapshot = stats.snapshot();
+  XCTAssertEqual(snapshot.renderCount, 0);
+  XCTAssertEqual(snapshot.minDuration, 0);
+  XCTAssertEqual(snapshot.p99Duration, 0);
 }
 
 @end
@@ -6,7 +6,11 @@ final class ParameterAddressTests: XCTestCase {
   func testParameterAddress() throws {
     XCTAssertEqual(ParameterAddress.rate.rawValue, 0)
     XCTAssertEqual(ParameterAddress.odd90.rawValue, 5)
-    XCTAssertEqual(ParameterAddress.allCases.count, 6)
+    XCTAssertEqual(ParameterAddress.quality.rawValue, 6)
+    XCTAssertEqual(ParameterAddress.voices.rawValue, 7)
+    XCTAssertEqual(ParameterAddress.feedback.rawValue, 8)
+    XCTAssertEqual(ParameterAddress.damping.rawValue, 9)
+    XCTAssertEqual(ParameterAddress.allCases.count, 10)
   }
 
   func testParameterDefinitions() throws {
@@ -37,6 +41,31 @@ final class ParameterAddressTests: XCTestCase {
     XCTAssertEqual(odd90.unit, .boolean)
     XCTAssertFalse(odd90.ramping)
     XCTAssertFalse(odd90.logScale)
+
+    let quality = ParameterAddress.quality.parameterDefinition
+    XCTAssertEqual(quality.range.lowerBound, 0.0)
+    XCTAssertEqual(quality.range.upperBound, 3.0)
+    XCTAssertEqual(quality.unit, .indexed)
+    XCTAssertFalse(quality.ramping)
+    XCTAssertFalse(quality.logScale)
+
+    let voices = ParameterAddress.voices.parameterDefinition
+    XCTAssertEqual(voices.range.lowerBound, 1.0)
+    XCTAssertEqual(voices.range.upperBound, 8.0)
+    XCTAssertEqual(voices.unit, .indexed)
+    XCTAssertFalse(voices.ramping)
+
+    let feedback = ParameterAddress.feedback.parameterDefinition
+    XCTAssertEqual(feedback.range.lowerBound, -95.0)
+    XCTAssertEqual(feedback.range.upperBound, 95.0)
+    XCTAssertEqual(feedback.unit, .percent)
+    XCTAssertTrue(feedback.ramping)
+
+    let damping = ParameterAddress.damping.parameterDefinition
+    XCTAssertEqual(damping.range.lowerBound, 0.0)
+    XCTAssertEqual(damping.range.upperBound, 100.0)
+    XCTAssertEqual(damping.unit, .percent)
+    XCTAssertFalse(damping.ramping)
   }
 
   func testAUParameterGeneration() throws {
@@ -13,5 +13,31 @@ final class AudioUnitParametersTests: XCTestCase {
     XCTAssertEqual(a.dry, 4.0)
     XCTAssertEqual(a.wet, 5.0)
     XCTAssertEqual(a.odd90, 0.0)
+    XCTAssertEqual(a.quality, 2.0)
+    XCTAssertEqual(a.voices, 1.0)
+    XCTAssertEqual(a.feedback, 0.0)
+    XCTAssertEqual(a.damping, 0.0)
+
+    let b = Configuration(rate: 1.0, delay: 2.0, depth: 3.0, dry: 4.0, wet: 5.0, odd90: 1.0, quality: 0.0,
+                          voices: 4.0, feedback: -40.0, damping: 25.0)
+    XCTAssertEqual(b.quality, 0.0)
+    XCTAssertEqual(b.voices, 4.0)
+    XCTAssertEqual(b.feedback, -40.0)
+    XCTAssertEqual(b.damping, 25.0)
+  }
+
+  func testKernelPreset() throws {
+    let preset = Configuration(rate: 1.0, delay: 2.0, depth: 3.0, dry: 4.0, wet: 5.0, odd90: 1.0, quality: 0.0,
+                               voices: 4.0, feedback: -40.0, damping: 25.0).kernelPreset
+    XCTAssertEqual(preset.rate, 1.0)
+    XCTAssertEqual(preset.delay, 2.0)
+    XCTAssertEqual(preset.depth, 3.0)
+    XCTAssertEqual(preset.dry, 4.0)
+    XCTAssertEqual(preset.wet, 5.0)
+    XCTAssertEqual(preset.odd90, 1.0)
+    XCTAssertEqual(preset.quality, 0.0)
+    XCTAssertEqual(preset.voices, 4.0)
+    XCTAssertEqual(preset.feedback, -40.0)
+    XCTAssertEqual(preset.damping, 25.0)
   }
 }
@@ -19,13 +19,17 @@ final class ConfigurationTests: XCTestCase {
     // Unfortunately, there is no init? for Obj-C enums
     // XCTAssertNil(ParameterAddress(rawValue: ParameterAddress.odd90.rawValue + 1))
 
-    XCTAssertEqual(ParameterAddress.allCases.count, 6)
+    XCTAssertEqual(ParameterAddress.allCases.count, 10)
     XCTAssertTrue(ParameterAddress.allCases.contains(.depth))
     XCTAssertTrue(ParameterAddress.allCases.contains(.rate))
     XCTAssertTrue(ParameterAddress.allCases.contains(.delay))
     XCTAssertTrue(ParameterAddress.allCases.contains(.dry))
     XCTAssertTrue(ParameterAddress.allCases.contains(.wet))
     XCTAssertTrue(ParameterAddress.allCases.contains(.odd90))
+    XCTAssertTrue(ParameterAddress.allCases.contains(.quality))
+    XCTAssertTrue(ParameterAddress.allCases.contains(.voices))
+    XCTAssertTrue(ParameterAddress.allCases.contains(.feedback))
+    XCTAssertTrue(ParameterAddress.allCases.contains(.damping))
   }
 
   func testParameterDefinitions() throws {
@@ -34,4 +38,21 @@ final class ConfigurationTests: XCTestCase {
       XCTAssertTrue(aup.parameters[index] == aup[address])
     }
   }
+
+  func testFactoryPresetGoesToKernel() throws {
+    let aup = Parameters()
+    let bridge = KernelBridge("ParametersTests", maxDelayMilliseconds: 50.0)
+    aup.kernel = bridge
+    aup.parameterTree.implementorValueObserver = { bridge.set($0, value: $1) }
+    aup.parameterTree.implementorValueProvider = { bridge.get($0) }
+
+    let jet = aup.factoryPresetValues[7]
+    XCTAssertEqual(jet.name, "Jet")
+    aup.useFactoryPreset(aup.factoryPresets[7], crossfadeFrames: 512)
+    for (parameter, value) in [(aup.delay, jet.preset.delay), (aup.depth, jet.preset.depth),
+                               (aup.feedback, jet.preset.feedback), (aup.damping, jet.preset.damping)] {
+      XCTAssertEqual(parameter.value, value)
+      XCTAssertEqual(bridge.get(parameter), value)
+    }
+  }
 }